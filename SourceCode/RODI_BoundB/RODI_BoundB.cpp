@@ -32,6 +32,14 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <map>
 #include <assert.h>
 #include <time.h>
 #include "SpinVideo.h"
@@ -42,6 +50,13 @@
 #include <conio.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "../RODI_Shared/RodiRawFormat.h"
+#include "../RODI_Shared/Demosaic.h"
+#include "../RODI_Shared/DifferenceMask.h"
+#include "../RODI_Shared/Manifest.h"
+#include "../RODI_Shared/FolderWatcher.h"
+#include "../RODI_Shared/BackgroundMode.h"
+#include "../RODI_Shared/BoundedQueue.h"
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
@@ -56,8 +71,19 @@ string inpath;
 string outpath;
 std::vector<std::string> filenames;
 string backgroundpath;
-int imageHeight = 1200;
-int imageWidth = 1920;
+int imageHeight = 1200; // only used for legacy headerless .tmp files
+int imageWidth = 1920; // only used for legacy headerless .tmp files
+Manifest manifest; // files analyzed in the output folder (RODI_BoundB.manifest)
+const size_t k_checkpointFrames = 100; // frames between manifest updates, an interrupted analysis resumes at the last one
+bool followMode = false; // files are analyzed while RODI_REC records them (--follow), a file that cannot be opened does not end the analysis
+IoThrottle readThrottle; // limits the read rate of the .tmp files in follow mode
+const int k_border = 150; // width of the inpainted border around the frame in the extended background
+const int k_cropMargin = 4; // raw pixels demosaiced around a crop, so the crop is identical to the one of a full-frame demosaic
+double backgroundRate = 0.01; // learning rate of the adaptive background per frame, 0 = the background image only (--background-rate)
+int backgroundFrames = 15; // frames whose per-pixel median starts the adaptive background of a file (--background-frames)
+bool learnForeground = false; // objects are learnt into the adaptive background as well (--learn-foreground)
+const size_t k_backgroundBatchFrames = 64; // frames detected against the same state of the adaptive background
+int detectionThreads = 0; // detector threads, 0 = one per hardware thread (--threads)
 
 /*
 ========================================================================================================================================
@@ -150,6 +176,375 @@ tuple<bool, vector<Rect>> frameCheck(Mat frame, Mat extended_background)
 	}
 }
 
+/*
+========================================================================================================================================
+BayerLuminance computes the half resolution luminance of a raw frame into luma (width / 2 x height / 2, CV_8UC1), one pixel per 2x2 cell
+of the Bayer mosaic from its red, the mean of its greens and its blue, with the weights of COLOR_BGR2GRAY. Mono8 frames are averaged
+2x2. No demosaicing is needed to look for objects.
+========================================================================================================================================
+*/
+void BayerLuminance(const uint8_t* raw, size_t stride, int width, int height, uint32_t pixelFormat, Mat& luma)
+{
+	luma.create(height / 2, width / 2, CV_8UC1);
+	const int red = RodiBayerRedCell(pixelFormat);
+	if (red < 0)
+	{
+		resize(Mat(height, width, CV_8UC1, const_cast<uint8_t*>(raw), stride), luma, luma.size(), 0, 0, INTER_AREA);
+		return;
+	}
+	const int blue = 3 - red;
+	const int green0 = red == 0 || red == 3 ? 1 : 0;
+	const int green1 = 3 - green0;
+	for (int y = 0; y < luma.rows; y++)
+	{
+		const uint8_t* row0 = raw + 2 * y * stride;
+		const uint8_t* row1 = row0 + stride;
+		uint8_t* out = luma.ptr<uint8_t>(y);
+		for (int x = 0; x < luma.cols; x++)
+		{
+			const int cell[4] = { row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1] };
+			// 0.299 R + 0.587 G + 0.114 B in 1/32768, the green weight applies to the sum of both greens
+			out[x] = static_cast<uint8_t>((9798 * cell[red] + 9617 * (cell[green0] + cell[green1]) + 3736 * cell[blue] + 16384) >> 15);
+		}
+	}
+}
+
+/*
+========================================================================================================================================
+FrameDetector finds drifting objects in the frames of a run and cuts their crops. Everything that only depends on the background is done
+once per frame size (Prepare): the grey and the half resolution luminance of the background, and the work images, which the frames then
+reuse without allocating. The analysed images are the frame plus a one pixel ring that belongs to the border of the extended frame: the
+difference is zero in the border, so analysing the extended frame (frameCheck) only differs from this where the blur spreads an object
+into that ring. DetectFrame gives exactly the boxes of frameCheck without pasting the frame into a copy of the extended background;
+DetectRaw works on the half resolution luminance of the raw frame (BayerLuminance), with the area threshold (500 full resolution pixels)
+and the approximation accuracy scaled to half resolution. ValidateDetection compares both. All boxes are in the coordinates of the
+extended frame.
+DetectRaw can compare with an AdaptiveBackground instead of the background image (ShareBackground). The extended background still fills
+the crops outside the frame. A detector is used by one thread at a time.
+========================================================================================================================================
+*/
+class FrameDetector
+{
+public:
+	explicit FrameDetector(const Mat& extendedBackground) : extended_background(extendedBackground), width(0), height(0), demosaic(DEMOSAIC_EDGE, 1) {}
+
+	// Prepare sets up the detector for width x height frames, returns false if the extended background is smaller than those
+	bool Prepare(int frameWidth, int frameHeight)
+	{
+		if (frameWidth == width && frameHeight == height) return true;
+		width = 0;
+		height = 0;
+		if (extended_background.cols < frameWidth + 2 * k_border || extended_background.rows < frameHeight + 2 * k_border) return false;
+		const Mat frameBackground = extended_background(Rect(k_border, k_border, frameWidth, frameHeight));
+		gray = Mat::zeros(frameHeight + 2, frameWidth + 2, CV_8UC1);
+		background_gray = Mat::zeros(gray.size(), CV_8UC1);
+		Mat grayInner = background_gray(Rect(1, 1, frameWidth, frameHeight));
+		cvtColor(frameBackground, grayInner, COLOR_BGR2GRAY);
+		luma = Mat::zeros(frameHeight / 2 + 2, frameWidth / 2 + 2, CV_8UC1);
+		width = frameWidth;
+		height = frameHeight;
+		UseImageBackground();
+		return true;
+	}
+
+	// UseImageBackground makes DetectRaw compare with the background image again, after ShareBackground
+	void UseImageBackground()
+	{
+		background_luma = Mat::zeros(luma.size(), CV_8UC1);
+		Mat lumaInner = background_luma(Rect(1, 1, width / 2, height / 2));
+		resize(background_gray(Rect(1, 1, width, height)), lumaInner, lumaInner.size(), 0, 0, INTER_AREA);
+	}
+
+	// DetectFrame finds the objects in a BGR frame of the prepared size
+	const vector<Rect>& DetectFrame(const Mat& frame)
+	{
+		Mat inner = gray(Rect(1, 1, width, height));
+		cvtColor(frame, inner, COLOR_BGR2GRAY);
+		return FindBoxes(gray, background_gray, 1, 500, 3, Point(k_border - 1, k_border - 1), 0);
+	}
+
+	// DetectRaw finds the objects in a raw frame of the prepared size
+	const vector<Rect>& DetectRaw(const uint8_t* raw, size_t stride, uint32_t pixelFormat)
+	{
+		Mat inner = luma(Rect(1, 1, width / 2, height / 2));
+		BayerLuminance(raw, stride, width, height, pixelFormat, inner);
+		// centre of half resolution pixel i is at 2 i + 0.5 in the frame
+		return FindBoxes(luma, background_luma, 2, 500 / 4.0, 1.5, Point(-1, -1), k_border + 0.5);
+	}
+
+	// ShareBackground makes DetectRaw compare with background (half resolution with the ring, AdaptiveBackground::Luma), which is shared, not copied
+	void ShareBackground(const Mat& background) { background_luma = background; }
+
+	// LastLuma and LastForeground return the luminance and the binarized difference of the last frame of DetectRaw, without the ring
+	Mat LastLuma() const { return luma(Rect(1, 1, width / 2, height / 2)); }
+	Mat LastForeground() const { return binary(Rect(1, 1, width / 2, height / 2)); }
+
+	/*
+	Crop returns the crop of box from a raw frame of the prepared size, as it would be cut from the demosaiced extended frame: the extended
+	background where the box leaves the frame, zeros where it leaves the extended frame. Only the part of the raw frame inside the box is
+	demosaiced, grown by k_cropMargin and aligned to the Bayer cell, which gives exactly the pixels of a full-frame demosaic. The crop is
+	valid until the next call.
+	*/
+	const Mat& Crop(const Rect& box, const uint8_t* raw, size_t stride, uint32_t pixelFormat)
+	{
+		crop.create(box.size(), CV_8UC3);
+		crop.setTo(Scalar(0, 0, 0));
+		const Rect inExtended = Rect(0, 0, extended_background.cols, extended_background.rows) & box;
+		if (inExtended.area() > 0) extended_background(inExtended).copyTo(crop(inExtended - box.tl()));
+		const Rect inFrame = Rect(k_border, k_border, width, height) & box;
+		if (inFrame.area() == 0) return crop;
+		const int x0 = max(0, inFrame.x - k_border - k_cropMargin) & ~1;
+		const int y0 = max(0, inFrame.y - k_border - k_cropMargin) & ~1;
+		const int x1 = min(width, inFrame.x - k_border + inFrame.width + k_cropMargin);
+		const int y1 = min(height, inFrame.y - k_border + inFrame.height + k_cropMargin);
+		Mat source(y1 - y0, x1 - x0, CV_8UC1, const_cast<uint8_t*>(raw) + static_cast<size_t>(y0) * stride + x0, stride);
+		region.create(y1 - y0, x1 - x0, CV_8UC3);
+		if (pixelFormat == RODI_PIXEL_MONO8) cvtColor(source, region, COLOR_GRAY2BGR);
+		else demosaic.Convert(source.data, source.step, source.cols, source.rows, pixelFormat, region.data, region.step);
+		region(Rect(inFrame.x - k_border - x0, inFrame.y - k_border - y0, inFrame.width, inFrame.height)).copyTo(crop(inFrame - box.tl()));
+		return crop;
+	}
+
+private:
+	FrameDetector(const FrameDetector&) = delete;
+	FrameDetector& operator=(const FrameDetector&) = delete;
+
+	/*
+	FindBoxes subtracts the background from image, blurs (3x3) and binarizes the difference in one pass (DifferenceMask, the same image as
+	absdiff, blur and threshold) and returns a square box 1.5 times the size of every contour larger than areaTresh, centred on its
+	centroid. contourOffset moves the contours into the coordinates the centroid is taken in, scale and origin map it to the extended frame.
+	*/
+	const vector<Rect>& FindBoxes(const Mat& image, const Mat& background, int scale, double areaTresh, double epsilon, Point contourOffset, double origin)
+	{
+		binary.create(image.rows, image.cols, CV_8UC1);
+		differenceMask.Compute(image.data, image.step, background.data, background.step, image.cols, image.rows, 20, binary.data, binary.step); // beyond the ring the difference is zero as well
+		findContours(binary, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE, contourOffset);
+		boxes.clear();
+		for (size_t n = 0; n < contours.size(); n++)
+		{
+			if (contourArea(contours[n], false) <= areaTresh) continue;
+			approxPolyDP(contours[n], poly, epsilon, true);
+			const Rect bound = boundingRect(poly);
+			const int l_edge = max(scale * bound.width, scale * bound.height) * 1.5;
+			Moments m = moments(contours[n], false);
+			const Point p(static_cast<int>(scale * m.m10 / m.m00 + origin), static_cast<int>(scale * m.m01 / m.m00 + origin));
+			boxes.push_back(Rect(p.x - l_edge / 2, p.y - l_edge / 2, l_edge, l_edge));
+		}
+		return boxes;
+	}
+
+	Mat extended_background;
+	int width; // prepared frame size, 0 before Prepare
+	int height;
+	Demosaic demosaic; // native edge-aware debayering of the crops, independent of the Spinnaker SDK
+	Mat gray, background_gray; // full resolution frame and background with the ring
+	Mat luma, background_luma; // half resolution frame and background with the ring
+	DifferenceMask differenceMask;
+	Mat binary;
+	vector<vector<Point>> contours;
+	vector<Vec4i> hierarchy;
+	vector<Point> poly;
+	vector<Rect> boxes;
+	Mat region, crop;
+};
+
+/*
+========================================================================================================================================
+AdaptiveBackground is a background that follows the changes of light, turbidity and sediment over a day, for FrameDetector::DetectRaw. It
+starts as the per-pixel median of the first frames of a file (Learn, Start), which leaves out the organisms drifting through them, and the
+frames are then blended into it with the learning rate (running average, Update). Pixels of objects found in a frame are left out of the
+update unless the foreground is learnt as well, so slow organisms are not absorbed. The frames are updated in their order, a batch at a
+time once its last frame has been detected, so the background does not depend on the number of detector threads.
+========================================================================================================================================
+*/
+class AdaptiveBackground
+{
+public:
+	AdaptiveBackground(double rate, bool updateForeground) : learningRate(rate), skipForeground(!updateForeground), width(0), height(0) {}
+
+	bool Enabled() const { return learningRate > 0; }
+
+	// Prepare clears the background for width x height frames
+	void Prepare(int frameWidth, int frameHeight)
+	{
+		width = frameWidth;
+		height = frameHeight;
+		luma = Mat::zeros(height / 2 + 2, width / 2 + 2, CV_8UC1);
+		model.release();
+		learnt.clear();
+	}
+
+	// Luma returns the background at half resolution with a one pixel ring, as FrameDetector::ShareBackground takes it
+	const Mat& Luma() const { return luma; }
+
+	// Learn keeps the luminance of a raw frame of the prepared size for Start
+	void Learn(const uint8_t* raw, size_t stride, uint32_t pixelFormat)
+	{
+		Mat frameLuma;
+		BayerLuminance(raw, stride, width, height, pixelFormat, frameLuma);
+		learnt.push_back(frameLuma);
+	}
+
+	// Start sets the background to the per-pixel median of the frames learnt since Prepare. Returns false if there are none.
+	bool Start()
+	{
+		if (learnt.empty()) return false;
+		const size_t n = learnt.size();
+		vector<uint8_t> values(n);
+		model.create(height / 2, width / 2, CV_32FC1);
+		for (int y = 0; y < model.rows; y++)
+		{
+			float* out = model.ptr<float>(y);
+			for (int x = 0; x < model.cols; x++)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					values[i] = learnt[i].ptr<uint8_t>(y)[x];
+				}
+				nth_element(values.begin(), values.begin() + n / 2, values.end());
+				out[x] = values[n / 2];
+			}
+		}
+		learnt.clear();
+		Mat inner = luma(Rect(1, 1, width / 2, height / 2));
+		model.convertTo(inner, CV_8U);
+		return true;
+	}
+
+	// Update blends the luminance of a frame into the background, leaving out its foreground (binarized difference) unless it is learnt
+	void Update(const Mat& frameLuma, const Mat& foreground)
+	{
+		if (model.empty()) return;
+		if (skipForeground)
+		{
+			compare(foreground, 0, updateMask, CMP_EQ);
+			accumulateWeighted(frameLuma, model, learningRate, updateMask);
+		}
+		else accumulateWeighted(frameLuma, model, learningRate);
+		Mat inner = luma(Rect(1, 1, width / 2, height / 2));
+		model.convertTo(inner, CV_8U);
+	}
+
+private:
+	AdaptiveBackground(const AdaptiveBackground&) = delete;
+	AdaptiveBackground& operator=(const AdaptiveBackground&) = delete;
+
+	const double learningRate; // per frame, 0 = background image
+	const bool skipForeground; // objects are left out of the update
+	int width;
+	int height;
+	Mat luma; // background at half resolution with the ring (CV_8UC1)
+	Mat model; // background at half resolution (CV_32FC1), empty until Start
+	Mat updateMask; // pixels updated by the last frame
+	vector<Mat> learnt; // luminance of the frames the background starts from
+};
+
+/*
+========================================================================================================================================
+BoxPipeline runs the detection of one .tmp file on several threads: a reader thread (ReadBoxFrames) views the frames in order, detector
+threads (DetectBoxFrames) each with their own FrameDetector find the objects of any frame and write its crops, and the calling thread
+commits the frames in their order (console, manifest checkpoints, adaptive background), so the output does not depend on the number of
+threads. A fixed pool of frame slots circulates between the stages. With an adaptive background the reader holds every
+k_backgroundBatchFrames frames until the frames before have been committed, and the committing thread updates the background with the
+frames of a batch only after its last frame: the frames of a batch are all compared with the background as updated by the batches before,
+and no detector reads the background while it changes.
+========================================================================================================================================
+*/
+struct BoxFrame
+{
+	size_t index = 0; // frame number in the file
+	vector<char> raw; // decoded frame of a compressed file
+	RodiFrameView view; // frame as handed out by the reader, points into raw or into the mapped file
+	size_t boxes = 0; // objects found
+	vector<string> boxFiles; // crops written
+	Mat luma, foreground; // luminance and binarized difference for the adaptive background
+};
+
+struct BoxPipeline
+{
+	explicit BoxPipeline(size_t depth) : pool(depth), freeFrames(depth), workFrames(depth), doneFrames(depth), committed(0), readFailed(false), detectorsRunning(0)
+	{
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			freeFrames.Push(&pool[i]);
+		}
+	}
+	// WaitCommitted (reader thread) waits until the frames before frame have been committed
+	void WaitCommitted(size_t frame)
+	{
+		unique_lock<mutex> lock(commitMutex);
+		commitChanged.wait(lock, [&] { return committed >= frame; });
+	}
+	// SetCommitted (committing thread) records that the frames before frame have been committed
+	void SetCommitted(size_t frame)
+	{
+		lock_guard<mutex> lock(commitMutex);
+		committed = frame;
+		commitChanged.notify_all();
+	}
+	deque<BoxFrame> pool;
+	BoundedQueue<BoxFrame*> freeFrames; // slots waiting for the reader
+	BoundedQueue<BoxFrame*> workFrames; // frames waiting for a detector
+	BoundedQueue<BoxFrame*> doneFrames; // frames waiting to be committed, in any order
+	mutex commitMutex;
+	condition_variable commitChanged;
+	size_t committed;
+	atomic<bool> readFailed;
+	atomic<int> detectorsRunning;
+};
+
+// ReadBoxFrames runs on the reader thread: it views (and decodes) the frames first to last - 1 of rawFile in free slots and passes them on
+void ReadBoxFrames(RodiRawReader* rawFile, size_t first, size_t last, bool batches, BoxPipeline* pipeline)
+{
+	try
+	{
+		for (size_t frameCnt = first; frameCnt < last; frameCnt++)
+		{
+			if (batches && frameCnt > first && (frameCnt - first) % k_backgroundBatchFrames == 0) pipeline->WaitCommitted(frameCnt);
+			BoxFrame* frame;
+			if (!pipeline->freeFrames.Pop(frame)) break;
+			if (!rawFile->ViewFrame(frameCnt, frame->view, frame->raw))
+			{
+				pipeline->readFailed = true;
+				break;
+			}
+			readThrottle.Acquire(frame->view.frameHeader.payloadSize > 0 ? frame->view.frameHeader.payloadSize : frame->view.size); // followMBps
+			frame->index = frameCnt;
+			if (!pipeline->workFrames.Push(frame)) break;
+		}
+	}
+	catch (Spinnaker::Exception&)
+	{
+		pipeline->readFailed = true;
+	}
+	pipeline->workFrames.Close();
+}
+
+// DetectBoxFrames runs on a detector thread: it finds the objects of the frames it takes and writes their crops to cropPrefix_frameN_boxK.tif
+void DetectBoxFrames(FrameDetector* detector, const string cropPrefix, bool keepLuma, BoxPipeline* pipeline)
+{
+	BoxFrame* frame;
+	while (pipeline->workFrames.Pop(frame))
+	{
+		const uint8_t* raw = reinterpret_cast<const uint8_t*>(frame->view.data);
+		const vector<Rect>& boundingBox = detector->DetectRaw(raw, frame->view.width, frame->view.pixelFormat);
+		frame->boxes = boundingBox.size();
+		for (size_t k = 0; k < boundingBox.size(); k++)
+		{
+			const string boxFilename = cropPrefix + "_frame" + to_string(frame->index) + "_box" + to_string(k) + ".tif";
+			imwrite(boxFilename, detector->Crop(boundingBox[k], raw, frame->view.width, frame->view.pixelFormat));
+			frame->boxFiles.push_back(fs::path(boxFilename).filename().string());
+		}
+		if (keepLuma)
+		{
+			detector->LastLuma().copyTo(frame->luma);
+			detector->LastForeground().copyTo(frame->foreground);
+		}
+		pipeline->doneFrames.Push(frame);
+	}
+	if (--pipeline->detectorsRunning == 0) pipeline->doneFrames.Close();
+}
+
 /*
 ========================================================================================================================================
 inpaint creates an extended background using the opencv inpaint function
@@ -190,72 +585,184 @@ Mat inpaint(string backgroundpath)
 }
 /*
 ========================================================================================================================================
-BoundingBoxAnalysis loops over each frame within each .tmp file and extracts bounding boxes of drifting objects
+AnalysisParameters returns the settings that change the bounding boxes of a .tmp file, as recorded in the manifest: the background image
+(name and content fingerprint), the number of frames analyzed per file and the background model.
+========================================================================================================================================
+*/
+string AnalysisParameters(size_t maxFrames)
+{
+	ManifestEntry background;
+	Manifest::Fingerprint(backgroundpath, background);
+	stringstream ss;
+	ss << "background=" << background.source << ":" << hex << background.hash << dec << ";frames=" << maxFrames << ";ImageWidth=" << imageWidth << ";ImageHeight=" << imageHeight
+		<< ";detection=bayer-half;backgroundModel=";
+	if (backgroundRate > 0) ss << "adaptive:" << backgroundRate << ":" << backgroundFrames << (learnForeground ? ":all" : ":background");
+	else ss << "image";
+	return ss.str();
+}
+
+/*
+========================================================================================================================================
+BoundingBoxAnalysis loops over each frame within each .tmp file and extracts bounding boxes of drifting objects. Objects are found on
+the half resolution luminance of the raw frames (FrameDetector::DetectRaw) on detectionThreads threads (BoxPipeline); only the crops of
+the boxes found are demosaiced. The manifest of the output folder records every file analyzed with the same background: such files are
+skipped, and a file whose analysis was interrupted continues at its last checkpoint (k_checkpointFrames) instead of the first frame. The
+adaptive background (backgroundRate) starts from the first backgroundFrames frames analyzed in each file, after a resume from those at
+the checkpoint.
 ========================================================================================================================================
 */
 int BoundingBoxAnalysis(vector<string>& filenames, int numFiles, Mat extended_background)
 {
 	int result = 0;
-	int frameSize = imageHeight * imageWidth;
+	const size_t maxFrames = 1000;
+	const string parameters = AnalysisParameters(maxFrames);
+	const size_t numThreads = detectionThreads > 0 ? detectionThreads : max(1u, thread::hardware_concurrency());
+	vector<unique_ptr<FrameDetector>> detectors;
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		detectors.emplace_back(new FrameDetector(extended_background));
+	}
+	AdaptiveBackground background(backgroundRate, learnForeground);
+	if (!manifest.Load(outpath, "RODI_BoundB"))
+	{
+		cout << "Failure: could not read " << manifest.Path() << endl;
+		return -1;
+	}
 	try
 	{
-		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++) // Open each .tmp file and extract images of size = frameSize
+		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++) // Open each .tmp file and extract its frames, geometry is taken from the file header
 		{
 			string FilePath = filenames.at(fileCnt);
-			cout << endl << "--- Retrieving frames from: " << FilePath.c_str() << " ---" << endl;
-			ifstream rawFile(filenames.at(fileCnt).c_str(), ios_base::in | ios_base::binary);
-			if (!rawFile)
+			ManifestEntry entry;
+			string reason;
+			const ManifestAction action = manifest.Check(FilePath, parameters, entry, reason);
+			if (action == MANIFEST_SKIP)
+			{
+				cout << endl << "--- " << FilePath.c_str() << " is up to date, skipped ---" << endl;
+				continue;
+			}
+			cout << endl << "--- Retrieving frames from: " << FilePath.c_str() << " (" << reason << ") ---" << endl;
+			RodiRawReader rawFile;
+			if (!rawFile.Open(FilePath, imageWidth, imageHeight))
 			{
-				cout << endl << "Could not open file! " << filenames.at(fileCnt).c_str() << "Press enter to exit." << endl;
+				if (followMode)
+				{
+					cout << "Failure: could not open file or file holds no complete frame! " << FilePath.c_str() << endl;
+					manifest.Begin(entry, false);
+					manifest.Fail(entry.source, vector<string>());
+					result = -1;
+					continue;
+				}
+				cout << endl << "Could not open file or file holds no complete frame! " << filenames.at(fileCnt).c_str() << "Press enter to exit." << endl;
 				getchar();
 				return -1;
 			}
-			// Frame retrieval from .tmp files. Binary data chunks (size = frameSize) are taken and imported into the frames-vector.
-			std::vector<cv::Mat> frames; // Create an empty frames vector of Mat objects
-			int frameCnt = 0; // set frameCnt to zero
+			cout << "	" << rawFile.Describe() << endl;
+			if (!rawFile.Map()) cout << "	memory mapping failed, reading with fread" << endl;
+			// Frame retrieval from .tmp files. Frames are viewed in the memory-mapped file through its seek table, without copying.
+			bool prepared = true;
+			for (size_t t = 0; t < numThreads; t++)
+			{
+				prepared = detectors[t]->Prepare(rawFile.Width(), rawFile.Height()) && prepared;
+			}
+			if (!prepared)
+			{
+				cout << "Failure: the background image is smaller than the frames of " << FilePath.c_str() << endl;
+				result = -1;
+				continue;
+			}
+			const size_t numFrames = rawFile.NumFrames() < maxFrames ? rawFile.NumFrames() : maxFrames;
+			const size_t firstFrame = action == MANIFEST_RESUME && entry.progress < numFrames ? static_cast<size_t>(entry.progress) : 0;
+			manifest.Begin(entry, firstFrame > 0);
+			bool adaptive = false; // the adaptive background has started, otherwise the detectors compare with the background image
+			if (background.Enabled())
+			{
+				background.Prepare(rawFile.Width(), rawFile.Height());
+				vector<char> frameBuffer; // decoded frame of a compressed file
+				RodiFrameView view;
+				size_t learnFrame = firstFrame;
+				for (; learnFrame < numFrames && learnFrame < firstFrame + backgroundFrames && rawFile.ViewFrame(learnFrame, view, frameBuffer); learnFrame++)
+				{
+					readThrottle.Acquire(view.frameHeader.payloadSize > 0 ? view.frameHeader.payloadSize : view.size);
+					background.Learn(reinterpret_cast<const uint8_t*>(view.data), view.width, view.pixelFormat);
+				}
+				adaptive = background.Start();
+				if (adaptive) cout << "	adaptive background from frames " << firstFrame << " to " << learnFrame - 1 << endl;
+				else cout << "	no frame for the adaptive background, using the background image" << endl;
+				for (size_t t = 0; t < numThreads; t++)
+				{
+					if (adaptive) detectors[t]->ShareBackground(background.Luma());
+					else detectors[t]->UseImageBackground(); // a previous file of the same size may have shared its adaptive background
+				}
+			}
+			vector<string> boxFiles; // written since the last checkpoint
+			if (firstFrame > 0) cout << "	resuming at frame " << firstFrame << endl;
 			cout << "Object detected in frames: ";
-			while (rawFile.good() && frameCnt < 1000)
+			const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			BoxPipeline pipeline(2 * numThreads + 2);
+			pipeline.SetCommitted(firstFrame);
+			pipeline.detectorsRunning = static_cast<int>(numThreads);
+			const string cropPrefix = outpath + "\\" + FilePath.substr(inpath.length() + 1, FilePath.length() - (inpath.length() + 5));
+			vector<thread> threads;
+			threads.emplace_back(ReadBoxFrames, &rawFile, firstFrame, numFrames, adaptive, &pipeline);
+			for (size_t t = 0; t < numThreads; t++)
+			{
+				threads.emplace_back(DetectBoxFrames, detectors[t].get(), cropPrefix, adaptive, &pipeline);
+			}
+			// Commit the frames in their order
+			map<size_t, BoxFrame*> pending; // detected ahead of the next frame to commit
+			vector<Mat> batchLuma(k_backgroundBatchFrames), batchForeground(k_backgroundBatchFrames); // frames of the batch for the adaptive background
+			size_t frameCnt = firstFrame;
+			BoxFrame* frame;
+			while (pipeline.doneFrames.Pop(frame))
 			{
-				// Reading frames from .tmp file
-				char* frameBuffer = new char[frameSize];
-				rawFile.read(frameBuffer, frameSize); //Extracts frameSize characters from the .tmp file and assigns it to frameBuffer
-				ImagePtr pImage = Image::Create(imageWidth, imageHeight, 0, 0, PixelFormat_BayerRG8, frameBuffer); // create an BayerRG8 Image Pointer 
-																												   // Transform binary image into an OpenCV Mat
-				ImagePtr convertedImage = pImage->Convert(PixelFormat_BGR8, HQ_LINEAR);
-				unsigned int XPadding = convertedImage->GetXPadding(); // image data contains padding. When allocating Mat container size, you need to account for the X,Y image data padding. 
-				unsigned int YPadding = convertedImage->GetYPadding();
-				unsigned int rowsize = convertedImage->GetWidth();
-				unsigned int colsize = convertedImage->GetHeight();
-				Mat frame = cv::Mat(colsize + YPadding, rowsize + XPadding, CV_8UC3, convertedImage->GetData(), convertedImage->GetStride());
-				Mat frame_extended = extended_frame(frame, extended_background);
-				// Analyze frame for bounding boxes
-				bool answer;
-				vector<Rect> boundingBox; // create an empty boundingBox vector of Rect Objects
-				tie(answer, boundingBox) = frameCheck(frame, extended_background);
-				if (answer == 1 && (int)boundingBox.size() > 0)
+				pending[frame->index] = frame;
+				for (map<size_t, BoxFrame*>::iterator next = pending.find(frameCnt); next != pending.end(); next = pending.find(frameCnt))
 				{
-					auto image_rect = Rect({}, frame_extended.size());
-					cout << (int)frameCnt << ", ";
-					for (int k = 0; k < (int)boundingBox.size(); k++)
+					frame = next->second;
+					pending.erase(next);
+					if (frameCnt > firstFrame && frameCnt % k_checkpointFrames == 0)
 					{
-						auto roi = boundingBox[k];
-						auto intersection = image_rect & roi;
-						auto intersection_roi = intersection - roi.tl();
-						Mat crop = cv::Mat::zeros(roi.size(), frame_extended.type());
-						frame_extended(intersection).copyTo(crop(intersection_roi));
-						string boxFilename = outpath + "\\" + FilePath.substr(inpath.length() + 1, FilePath.length() - (inpath.length() + 5)) + "_frame" += to_string(frameCnt) + "_box" += to_string(k) + ".tif";
-					cv:imwrite(boxFilename, crop);
+						manifest.Progress(entry.source, frameCnt, boxFiles);
+						boxFiles.clear();
 					}
-					delete[] frameBuffer; // delete frameBuffer
-				}
-				else
-				{
-					delete[] frameBuffer; // delete frameBuffer
+					if (frame->boxes > 0) cout << (int)frameCnt << ", ";
+					boxFiles.insert(boxFiles.end(), frame->boxFiles.begin(), frame->boxFiles.end());
+					if (adaptive)
+					{
+						// the detectors read the background until the last frame of the batch is detected, the next batch is read once it is committed
+						const size_t batchFrame = (frameCnt - firstFrame) % k_backgroundBatchFrames;
+						swap(batchLuma[batchFrame], frame->luma);
+						swap(batchForeground[batchFrame], frame->foreground);
+						if (batchFrame == k_backgroundBatchFrames - 1 || frameCnt + 1 == numFrames)
+						{
+							for (size_t n = 0; n <= batchFrame; n++)
+							{
+								background.Update(batchLuma[n], batchForeground[n]);
+							}
+						}
+					}
+					pipeline.SetCommitted(++frameCnt);
+					frame->boxFiles.clear();
+					frame->view.keepAlive.reset(); // the mapped window may be unmapped once no slot uses it
+					pipeline.freeFrames.Push(frame);
 				}
-				frameCnt++; // update frame counter
 			}
-			cout << endl << endl;
-			rawFile.close(); // Close .tmp file
+			pipeline.freeFrames.Close();
+			for (size_t t = 0; t < threads.size(); t++)
+			{
+				threads[t].join();
+			}
+			const bool complete = !pipeline.readFailed && frameCnt == numFrames;
+			if (complete) manifest.Finish(entry.source, numFrames, boxFiles);
+			else manifest.Fail(entry.source, boxFiles);
+			cout << endl;
+			const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			cout << "	" << frameCnt - firstFrame << " frames in " << seconds << " s (" << (seconds > 0 ? (frameCnt - firstFrame) / seconds : 0) << " frames/s, "
+				<< numThreads << " detector thread(s))" << endl;
+			if (rawFile.Compressed()) cout << "	" << rawFile.DecodeStats() << endl;
+			cout << endl;
+			rawFile.Close(); // Close .tmp file
 		}
 	}
 	catch (Spinnaker::Exception& e)
@@ -269,18 +776,214 @@ int BoundingBoxAnalysis(vector<string>& filenames, int numFiles, Mat extended_ba
 }
 
 
+/*
+========================================================================================================================================
+ValidateDetection runs the detection of the first maxFrames frames of every .tmp file in folder three ways and reports their frame
+rates: frameCheck on the demosaiced frame (the reference, which pastes every frame into a copy of the extended background and converts
+the background to grey again), FrameDetector::DetectFrame on the demosaiced frame, which must give the same boxes, and
+FrameDetector::DetectRaw on the raw frame, crops included. The binarized difference of DifferenceMask, which FrameDetector uses, must be
+identical to absdiff, blur and threshold on every frame, with either border and on every instruction set; the time of both is reported.
+A box of DetectRaw matches a box of frameCheck when its centre is within a quarter of the edge of the frameCheck box and its edge within
+25 % of it. The half resolution detection is accepted when both agree on at least 99 % of the frames (object or no object) and at least
+95 % of the boxes match; objects close to the area threshold or touching other objects are where the two differ, as the blur covers 6x6
+instead of 3x3 pixels.
+========================================================================================================================================
+*/
+int ValidateDetection(const string& folder, Mat extended_background, size_t maxFrames)
+{
+	unsigned long long frames = 0, identical = 0, agreed = 0, referenceBoxes = 0, matchedBoxes = 0, boxes = 0;
+	double demosaicSeconds = 0, referenceSeconds = 0, detectorSeconds = 0, rawSeconds = 0, sequenceSeconds = 0, maskSeconds = 0;
+	unsigned long long maskMismatches = 0;
+	DifferenceMask scalarMask(DEMOSAIC_SCALAR), sse41Mask(DEMOSAIC_SSE41), avx2Mask(DEMOSAIC_AVX2);
+	DifferenceMask* masks[3] = { &scalarMask, &sse41Mask, &avx2Mask }; // by DemosaicIsa
+	FrameDetector detector(extended_background);
+	for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator(); i++)
+	{
+		if (is_directory(i->path()) || i->path().extension() != ".tmp") continue;
+		RodiRawReader rawFile;
+		if (!rawFile.Open(i->path().string(), imageWidth, imageHeight) || !rawFile.Map() || !detector.Prepare(rawFile.Width(), rawFile.Height())) continue;
+		Demosaic demosaic(DEMOSAIC_EDGE);
+		Mat frame(rawFile.Height(), rawFile.Width(), CV_8UC3), gray, background_gray, diff, diffblur, binary, mask(rawFile.Height(), rawFile.Width(), CV_8UC1);
+		cvtColor(extended_background(Rect(k_border, k_border, rawFile.Width(), rawFile.Height())), background_gray, COLOR_BGR2GRAY);
+		vector<char> frameBuffer;
+		RodiFrameView view;
+		for (size_t f = 0; f < rawFile.NumFrames() && f < maxFrames && rawFile.ViewFrame(f, view, frameBuffer); f++)
+		{
+			const uint8_t* raw = reinterpret_cast<const uint8_t*>(view.data);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			Mat rawMat(view.height, view.width, CV_8UC1, const_cast<uint8_t*>(raw));
+			if (view.pixelFormat == RODI_PIXEL_MONO8) cvtColor(rawMat, frame, COLOR_GRAY2BGR);
+			else demosaic.Convert(raw, view.width, view.width, view.height, view.pixelFormat, frame.data, frame.step);
+			chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+			demosaicSeconds += chrono::duration<double>(stop - start).count();
+			start = stop;
+			bool referenceAnswer;
+			vector<Rect> referenceBox;
+			tie(referenceAnswer, referenceBox) = frameCheck(frame, extended_background);
+			Mat frame_extended = extended_frame(frame, extended_background); // cropped from, as BoundingBoxAnalysis did
+			stop = chrono::steady_clock::now();
+			referenceSeconds += chrono::duration<double>(stop - start).count();
+			start = stop;
+			const vector<Rect> detectorBox = detector.DetectFrame(frame);
+			stop = chrono::steady_clock::now();
+			detectorSeconds += chrono::duration<double>(stop - start).count();
+			start = stop;
+			const vector<Rect> rawBox = detector.DetectRaw(raw, view.width, view.pixelFormat);
+			for (size_t b = 0; b < rawBox.size(); b++)
+			{
+				detector.Crop(rawBox[b], raw, view.width, view.pixelFormat);
+			}
+			rawSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			cvtColor(frame, gray, COLOR_BGR2GRAY);
+			for (int border = 0; border < 2; border++)
+			{
+				start = chrono::steady_clock::now();
+				absdiff(background_gray, gray, diff);
+				blur(diff, diffblur, Size(3, 3), Point(-1, -1), border ? BORDER_REFLECT_101 : BORDER_CONSTANT);
+				threshold(diffblur, binary, 20, 255, THRESH_BINARY);
+				stop = chrono::steady_clock::now();
+				sequenceSeconds += chrono::duration<double>(stop - start).count();
+				for (int isa = 0; isa <= Demosaic::BestIsa(); isa++)
+				{
+					start = chrono::steady_clock::now();
+					masks[isa]->Compute(gray.data, gray.step, background_gray.data, background_gray.step, gray.cols, gray.rows, 20, mask.data, mask.step, border == 1);
+					if (isa == Demosaic::BestIsa()) maskSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+					if (norm(binary, mask, NORM_INF) != 0) maskMismatches++;
+				}
+			}
+			frames++;
+			if (detectorBox == referenceBox) identical++;
+			if (referenceBox.empty() == rawBox.empty()) agreed++;
+			referenceBoxes += referenceBox.size();
+			boxes += rawBox.size();
+			for (size_t r = 0; r < referenceBox.size(); r++)
+			{
+				const Rect& a = referenceBox[r];
+				for (size_t b = 0; b < rawBox.size(); b++)
+				{
+					const Rect& c = rawBox[b];
+					const double dx = (a.x + a.width / 2.0) - (c.x + c.width / 2.0);
+					const double dy = (a.y + a.height / 2.0) - (c.y + c.height / 2.0);
+					if (sqrt(dx * dx + dy * dy) <= a.width / 4.0 && abs(c.width - a.width) <= a.width / 4.0)
+					{
+						matchedBoxes++;
+						break;
+					}
+				}
+			}
+		}
+		cout << "	" << i->path().filename().string() << ": " << frames << " frames compared so far" << endl;
+	}
+	if (frames == 0)
+	{
+		cout << "Failure: no frames to compare in " << folder << endl;
+		return -1;
+	}
+	const double frameAgreement = 100.0 * agreed / frames;
+	const double boxAgreement = referenceBoxes > 0 ? 100.0 * matchedBoxes / referenceBoxes : 100.0;
+	cout << "	frames: " << frames << ", FrameDetector on the demosaiced frame identical to frameCheck on " << identical << endl;
+	cout << "	half resolution detection agrees on " << frameAgreement << " % of the frames" << endl;
+	cout << "	boxes: " << referenceBoxes << " full frame, " << boxes << " half resolution, " << boxAgreement << " % matched" << endl;
+	cout << "	frames per second: demosaic + frameCheck " << frames / (demosaicSeconds + referenceSeconds) << ", demosaic + FrameDetector "
+		<< frames / (demosaicSeconds + detectorSeconds) << ", FrameDetector on the raw frame with crops " << frames / rawSeconds << endl;
+	cout << "	frames per second of the detection alone: frameCheck " << frames / referenceSeconds << ", FrameDetector " << frames / detectorSeconds << endl;
+	cout << "	binarized difference: " << maskMismatches << " mismatches, absdiff + blur + threshold " << 1000 * sequenceSeconds / (2 * frames) << " ms, DifferenceMask ("
+		<< Demosaic::IsaName(Demosaic::BestIsa()) << ") " << 1000 * maskSeconds / (2 * frames) << " ms per frame" << endl;
+	const bool accepted = identical == frames && maskMismatches == 0 && frameAgreement >= 99 && boxAgreement >= 95;
+	cout << (accepted ? "	within tolerance" : "	Failure: outside tolerance") << endl;
+	return accepted ? 0 : -1;
+}
+
+/*
+========================================================================================================================================
+Follow analyzes the recording in inpath while RODI_REC is still writing it: every .tmp file is analyzed as soon as RODI_REC has finalized
+it (FolderWatcher), so the bounding boxes are ready minutes after the capture. The process runs with low CPU and I/O priority and reads at
+most maxMBps, so it never holds up the acquisition on the same machine. Runs until closed, or until no new file was finalized for
+exitMinutes (0 = never).
+========================================================================================================================================
+*/
+int Follow(int settleSeconds, int maxMBps, int exitMinutes)
+{
+	const int k_pollMs = 5000; // longest wait between two listings of the folder
+	int result = 0;
+	followMode = true;
+	if (!EnterBackgroundMode()) cout << "	could not lower the process priority" << endl;
+	readThrottle.SetLimit(static_cast<uint64_t>(maxMBps) * 1000000ull);
+	FolderWatcher watcher;
+	if (!fs::is_directory(outpath) || !watcher.Open(inpath, settleSeconds))
+	{
+		cout << "Failure: could not watch " << inpath << " or output folder " << outpath << " does not exist" << endl;
+		return -1;
+	}
+	Mat extended_background = inpaint(backgroundpath);
+	cout << endl << "--- Following " << inpath << (watcher.Notified() ? "" : " (polling)") << ", bounding boxes to " << outpath << " ---" << endl;
+	chrono::steady_clock::time_point lastFile = chrono::steady_clock::now();
+	while (true)
+	{
+		vector<string> ready = watcher.ReadyFiles();
+		if (!ready.empty())
+		{
+			if (BoundingBoxAnalysis(ready, ready.size(), extended_background) != 0) result = -1;
+			lastFile = chrono::steady_clock::now();
+			continue; // list again right away, more files may have been finalized during the analysis
+		}
+		if (exitMinutes > 0 && chrono::steady_clock::now() - lastFile >= chrono::minutes(exitMinutes))
+		{
+			cout << endl << "--- No new .tmp file for " << exitMinutes << " minutes, follow mode ends ---" << endl;
+			break;
+		}
+		watcher.Wait(k_pollMs);
+	}
+	return result;
+}
+
 /*
 ========================================================================================================================================
 Main function of the script. In here input and output folders are defined and the bounding box analysis started.
 ========================================================================================================================================
 */
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
 	int result = 0;
+	// Options ahead of the mode: --background-rate <rate> (adaptive background, 0 = background image only), --background-frames <frames>
+	// (median that starts the adaptive background), --learn-foreground (objects are learnt into the adaptive background as well) and
+	// --threads <threads> (detector threads, 0 = one per hardware thread)
+	int options = 1;
+	while (options < argc)
+	{
+		const string option = argv[options];
+		if (option == "--background-rate" && options + 1 < argc) backgroundRate = stod(argv[++options]);
+		else if (option == "--background-frames" && options + 1 < argc) backgroundFrames = max(1, stoi(argv[++options]));
+		else if (option == "--learn-foreground") learnForeground = true;
+		else if (option == "--threads" && options + 1 < argc) detectionThreads = max(0, stoi(argv[++options]));
+		else break;
+		options++;
+	}
+	argc -= options - 1;
+	argv += options - 1;
+	// RODI_BoundB --follow <input folder> <output folder> <background.tif> [<settle seconds> [<max MB/s> [<exit minutes>]]] analyzes the
+	// .tmp files while they are being recorded. A file without seek footer (interrupted recording) is analyzed after not changing for
+	// settle seconds (300). Follow mode ends after exit minutes without a new file (0 = runs until closed).
+	// RODI_BoundB --validate-detection <folder> <background.tif> [<frames>] compares and times the detection paths and exits
+	if ((argc == 4 || argc == 5) && string(argv[1]) == "--validate-detection")
+	{
+		backgroundpath = argv[3];
+		cout << endl << "--- Validating the detection on " << argv[2] << " ---" << endl;
+		return ValidateDetection(argv[2], inpaint(backgroundpath), argc == 5 ? stoul(argv[4]) : 200);
+	}
+	if (argc >= 5 && argc <= 8 && string(argv[1]) == "--follow")
+	{
+		inpath = argv[2];
+		outpath = argv[3];
+		backgroundpath = argv[4];
+		return Follow(argc >= 6 ? stoi(argv[5]) : 300, argc >= 7 ? stoi(argv[6]) : 0, argc == 8 ? stoi(argv[7]) : 0);
+	}
 	// Print application build information
 	cout << "*************************************************************" << endl;
 	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
 	cout << "*************************************************************" << endl;
+	if (backgroundRate > 0) cout << "Adaptive background: learning rate " << backgroundRate << ", started from " << backgroundFrames << " frames" << (learnForeground ? ", objects learnt" : "") << endl;
+	else cout << "Static background image" << endl;
 	// ASCII logo: http://patorjk.com/software/taag/#p=display&h=3&v=2&f=Slant%20Relief&t=RODI_conv
 	std::cout << R"(  
 
@@ -302,7 +1005,7 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 	fs::path p(inpath);
 	for (auto i = fs::directory_iterator(p); i != fs::directory_iterator(); i++)
 	{
-		if (!is_directory(i->path()))
+		if (!is_directory(i->path()) && i->path().extension() == ".tmp") // only the recordings, not the frame indexes or logs next to them
 		{
 			filenames.push_back(i->path().string());
 		}
@@ -0,0 +1,171 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Conversion script)
+// FfmpegVideo is the alternative encoder backend of RODI_CONV: it streams raw frames through a pipe into an ffmpeg process, which encodes
+// them with libx264 (H.264) or its MJPEG encoder into .mp4 or .mkv files. Bayer frames are passed as they are recorded and debayered by
+// ffmpeg, debayered frames as BGR. The lossless mode keeps the data exactly: Bayer frames are stored as a grey image of the mosaic with
+// libx264 at qp 0, BGR frames with libx264rgb at qp 0. libx264 encodes on several threads (frame threading, or slices with
+// slicedThreads). Like SpinVideo a new file (name-0001.mp4, ...) is started when maxFileBytes is reached.
+//========================================================================================================================================
+
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <csignal>
+#include <boost/filesystem.hpp>
+
+struct FfmpegOptions
+{
+	std::string ffmpegPath = "ffmpeg";
+	std::string codec = "x264"; // x264 or mjpeg
+	std::string container = "mp4"; // mp4 or mkv
+	std::string preset = "veryfast"; // libx264 preset, ultrafast .. veryslow
+	int crf = -1; // libx264 constant rate factor 0-51, -1 = constant bitrate
+	int bitrate = 0; // bits per second when crf = -1
+	int quality = 90; // MJPEG quality 1-100
+	bool lossless = false;
+	int threads = 0; // encoder threads, 0 = chosen by the encoder
+	bool slicedThreads = false; // libx264 threads encode slices of the same frame (lower latency) instead of consecutive frames
+	uint64_t maxFileBytes = 0; // start a new file when a file reaches this size, 0 = no limit
+	double frameRate = 25;
+	int width = 0;
+	int height = 0;
+	std::string pixelFormat = "bayer_rggb8"; // ffmpeg name of the input pixel format: gray, bayer_rggb8, ..., bgr24
+};
+
+class FfmpegVideo
+{
+public:
+	FfmpegVideo() : pipe(nullptr), frameBytes(0), files(0), framesInFile(0) {}
+	~FfmpegVideo() { Close(); }
+
+	// Open starts the ffmpeg process for basename (without extension). Returns false if the process cannot be started.
+	bool Open(const std::string& basename, const FfmpegOptions& videoOptions)
+	{
+		Close();
+		name = basename;
+		options = videoOptions;
+		frameBytes = static_cast<size_t>(options.width) * options.height * (options.pixelFormat == "bgr24" ? 3 : 1);
+		files = 0;
+#ifndef _WIN32
+		signal(SIGPIPE, SIG_IGN); // a failed ffmpeg process makes fwrite fail instead of ending RODI_CONV
+#endif
+		return OpenFile();
+	}
+
+	// Append writes one frame of width x height pixels in the input pixel format. Returns false if ffmpeg stopped accepting frames.
+	bool Append(const void* data)
+	{
+		if (pipe == nullptr) return false;
+		if (options.maxFileBytes > 0 && ++framesInFile % k_sizeCheckFrames == 0)
+		{
+			boost::system::error_code ec;
+			const uintmax_t size = boost::filesystem::file_size(path, ec);
+			if (!ec && size >= options.maxFileBytes && (!CloseFile() || !OpenFile())) return false;
+		}
+		return fwrite(data, 1, frameBytes, pipe) == frameBytes;
+	}
+
+	// Close finishes the current file. Returns false if ffmpeg reported an error.
+	bool Close()
+	{
+		return CloseFile();
+	}
+
+	int Files() const { return files; }
+	std::string Path() const { return path; } // current (last) output file
+	std::string Error() const { return error; }
+
+	// Command returns the ffmpeg command line for output
+	std::string Command(const std::string& output) const
+	{
+		std::stringstream cmd;
+		cmd << "\"" << options.ffmpegPath << "\" -hide_banner -loglevel error -nostdin -y -f rawvideo -pix_fmt " << InputFormat()
+			<< " -s " << options.width << "x" << options.height << " -r " << options.frameRate << " -i - ";
+		if (options.codec == "mjpeg")
+		{
+			const int q = 31 - (options.quality - 1) * 29 / 99; // quality 1-100 to ffmpeg qscale 31-2
+			cmd << "-c:v mjpeg -pix_fmt yuvj420p -q:v " << (q < 2 ? 2 : q > 31 ? 31 : q);
+			if (options.threads > 0) cmd << " -threads " << options.threads;
+		}
+		else
+		{
+			if (options.lossless)
+			{
+				cmd << (options.pixelFormat == "bgr24" ? "-c:v libx264rgb -pix_fmt bgr24" : "-c:v libx264 -pix_fmt gray") << " -qp 0";
+			}
+			else
+			{
+				cmd << "-c:v libx264 -pix_fmt yuv420p ";
+				if (options.crf >= 0) cmd << "-crf " << options.crf;
+				else cmd << "-b:v " << options.bitrate;
+			}
+			cmd << " -preset " << options.preset << " -threads " << options.threads;
+			if (options.slicedThreads) cmd << " -x264-params sliced-threads=1";
+		}
+		cmd << " \"" << output << "\"";
+		return cmd.str();
+	}
+
+private:
+	static const unsigned k_sizeCheckFrames = 25; // frames between file size checks
+
+	FfmpegVideo(const FfmpegVideo&) = delete;
+	FfmpegVideo& operator=(const FfmpegVideo&) = delete;
+
+	// InputFormat returns the pixel format ffmpeg reads; lossless Bayer frames are read as grey so the mosaic is kept as recorded
+	std::string InputFormat() const
+	{
+		return options.lossless && options.pixelFormat.compare(0, 6, "bayer_") == 0 ? "gray" : options.pixelFormat;
+	}
+
+	bool OpenFile()
+	{
+		std::stringstream ss;
+		ss << name;
+		if (files > 0) ss << "-" << std::string(4 - std::to_string(files).size(), '0') << files;
+		ss << "." << options.container;
+		path = ss.str();
+#ifdef _WIN32
+		const std::string command = "\"" + Command(path) + "\""; // cmd.exe strips the outer quotes
+		pipe = _popen(command.c_str(), "wb");
+#else
+		pipe = popen(Command(path).c_str(), "w");
+#endif
+		if (pipe == nullptr)
+		{
+			error = "could not start " + options.ffmpegPath;
+			return false;
+		}
+		files++;
+		framesInFile = 0;
+		return true;
+	}
+
+	bool CloseFile()
+	{
+		if (pipe == nullptr) return true;
+#ifdef _WIN32
+		const int status = _pclose(pipe);
+#else
+		const int status = pclose(pipe);
+#endif
+		pipe = nullptr;
+		if (status != 0)
+		{
+			error = options.ffmpegPath + " failed on " + path + " (exit status " + std::to_string(status) + ")";
+			return false;
+		}
+		return true;
+	}
+
+	FfmpegOptions options;
+	std::string name;
+	std::string path;
+	std::string error;
+	FILE* pipe;
+	size_t frameBytes;
+	int files;
+	unsigned long long framesInFile;
+};
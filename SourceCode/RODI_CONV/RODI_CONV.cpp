@@ -29,8 +29,11 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <iomanip>
 #include <string>
 #include <vector>
+#include <map>
+#include <atomic>
 #include <ctime>
 #include <assert.h>
 #include <time.h>
@@ -42,6 +45,21 @@
 #include <conio.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include "../RODI_Shared/RodiRawFormat.h"
+#include "../RODI_Shared/FrameIndex.h"
+#include "../RODI_Shared/MappedFile.h"
+#include "../RODI_Shared/Demosaic.h"
+#include "../RODI_Shared/Manifest.h"
+#include "../RODI_Shared/FolderWatcher.h"
+#include "../RODI_Shared/BackgroundMode.h"
+#include "FfmpegVideo.h"
+#include "../RODI_Shared/BoundedQueue.h"
+#include "../RODI_Shared/MemoryBudget.h"
+#include "../RODI_Shared/WorkStealingScheduler.h"
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
@@ -58,13 +76,103 @@ string inpath;
 string outpath;
 std::vector<std::string> filenames;
 double FPS;
-int imageHeight;
-int imageWidth;
-std::string chosenVideoType;
+int imageHeight; // only used for legacy headerless .tmp files
+int imageWidth; // only used for legacy headerless .tmp files
+std::string chosenVideoType; // MJPG, H264, UNCOMPRESSED (SpinVideo .avi) or X264, FFMJPG (ffmpeg .mp4/.mkv)
 int h264bitrate; // 1000000 - 16000000
 int mjpgquality; //1-100
 int maxVideoSize; // max file size in GB, 0 indicates no limit (not recommended).
-int maxRAM; // max RAM in GB to store frames in working memory
+std::string ffmpegPath = "ffmpeg"; // ffmpeg executable of the X264 and FFMJPG video types
+std::string videoContainer = "mp4"; // mp4 or mkv (X264, FFMJPG)
+std::string x264preset = "veryfast"; // libx264 speed/compression preset, ultrafast .. veryslow
+int x264crf = -1; // libx264 constant rate factor 0-51, -1 = constant bitrate h264bitrate
+int videoLossless = 0; // 1 = X264 stores the frames losslessly (qp 0), Bayer frames as the recorded mosaic
+int encoderThreads = 0; // X264/FFMJPG encoder threads, 0 = chosen by the encoder
+int slicedThreads = 0; // 1 = libx264 threads encode slices of one frame instead of consecutive frames
+int maxRAM; // max RAM in GB to store frames in working memory, shared by all conversion pipelines (0 = no limit)
+MemoryBudget ramBudget; // enforces maxRAM on the frame buffers of the conversion pipelines
+int debayer = 0; // 1 = debayer Bayer frames to BGR8 on a separate thread before encoding, 0 = hand the raw frames to the encoder
+std::string demosaic = "edge"; // debayering method: edge (edge-aware), bilinear or spinnaker (Spinnaker HQ_LINEAR)
+int demosaicThreads = 0; // threads per frame for the edge and bilinear methods, 0 = one per logical processor
+int pipelineDepth = 8; // frames in flight between reading and encoding
+int parallelFiles = 1; // files converted at the same time, 0 = one per logical processor
+int mappedRead = 1; // 1 = memory-map the .tmp files and hand frames to the encoder without copying, 0 = read them with fread
+int useManifest = 1; // 1 = skip files that RODI_CONV.manifest in the output folder lists as converted with the same parameters, 0 = convert all
+Manifest manifest; // conversions done in the output folder
+int followSettleSeconds = 300; // follow mode: a .tmp file without seek footer (interrupted recording) is converted after not changing for this long
+int followExitMinutes = 0; // follow mode: stop after this many minutes without a new .tmp file, 0 = follow until closed
+int followMBps = 0; // follow mode: maximum read rate of the .tmp files in MB/s, 0 = no limit
+int followBackground = 1; // follow mode: 1 = run with low CPU and I/O priority, so the recording always comes first
+IoThrottle readThrottle; // limits the read rate of all conversion pipelines to followMBps
+// VideoSettings holds the settings of one of the videos written for every .tmp file. videoOutputs[0] is the main video (chosenVideoType,
+// h264bitrate, ... of metadata.txt), every further video is set with outputN.key=value lines (N = 1, 2, ...). Keys that are not given for
+// outputN are taken from the main video. Example of a quick-look video next to the archive: output1.chosenVideoType=X264,
+// output1.scale=0.25, output1.decimation=5 (quarter resolution, every fifth frame).
+struct VideoSettings
+{
+	std::string suffix; // appended to the name of the video, "_outputN" unless set
+	std::string chosenVideoType;
+	int h264bitrate = 0;
+	int mjpgquality = 0;
+	int maxVideoSize = 0;
+	std::string videoContainer;
+	std::string x264preset;
+	int x264crf = -1;
+	int videoLossless = 0;
+	double scale = 1; // width and height relative to the recorded frames, 0 < scale <= 1
+	int decimation = 1; // every decimation-th frame is written, at Framerate / decimation
+};
+std::vector<VideoSettings> videoOutputs; // main video and the outputN videos, fed from the same read (and debayered) frames
+std::map<int, std::map<std::string, std::string>> outputKeys; // outputN.key=value lines of metadata.txt
+/*
+========================================================================================================================================
+BuildVideoOutputs sets videoOutputs from the main video settings and the outputN.key=value lines of metadata.txt, and prints the further
+videos.
+========================================================================================================================================
+*/
+void BuildVideoOutputs()
+{
+	VideoSettings main;
+	main.chosenVideoType = chosenVideoType;
+	main.h264bitrate = h264bitrate;
+	main.mjpgquality = mjpgquality;
+	main.maxVideoSize = maxVideoSize;
+	main.videoContainer = videoContainer;
+	main.x264preset = x264preset;
+	main.x264crf = x264crf;
+	main.videoLossless = videoLossless;
+	videoOutputs.assign(1, main);
+	for (auto it = outputKeys.begin(); it != outputKeys.end(); ++it)
+	{
+		VideoSettings video = main;
+		video.suffix = "_output" + to_string(it->first);
+		for (auto key = it->second.begin(); key != it->second.end(); ++key)
+		{
+			const string& name = key->first;
+			const string& value = key->second;
+			if (name == "suffix") video.suffix = value;
+			else if (name == "chosenVideoType") video.chosenVideoType = value;
+			else if (name == "h264bitrate") video.h264bitrate = std::stoi(value);
+			else if (name == "mjpgquality") video.mjpgquality = std::stoi(value);
+			else if (name == "maxVideoSize") video.maxVideoSize = std::stoi(value);
+			else if (name == "videoContainer") video.videoContainer = value;
+			else if (name == "x264preset") video.x264preset = value;
+			else if (name == "x264crf") video.x264crf = std::stoi(value);
+			else if (name == "videoLossless") video.videoLossless = std::stoi(value);
+			else if (name == "scale") video.scale = std::stod(value);
+			else if (name == "decimation") video.decimation = std::stoi(value);
+			else cout << "unknown setting output" << it->first << "." << name << endl;
+		}
+		if (video.videoContainer != "mkv") video.videoContainer = "mp4";
+		if (video.scale <= 0 || video.scale > 1) video.scale = 1;
+		if (video.decimation < 1) video.decimation = 1;
+		videoOutputs.push_back(video);
+		cout << "output" << it->first << ": chosenVideoType=" << video.chosenVideoType << ", suffix=" << video.suffix << ", scale=" << video.scale
+			<< ", decimation=" << video.decimation << ", maxVideoSize=" << video.maxVideoSize << " GB" << endl;
+	}
+}
+
+mutex consoleMutex; // keeps the output of files converted in parallel apart
 /*
 ========================================================================================================================================
 readconfig() opens the metadata.txt file and updates script parameters
@@ -92,7 +200,30 @@ auto readconfig(string metadata)
 			else if (name == "h264bitrate") h264bitrate = std::stod(value);
 			else if (name == "mjpgquality") mjpgquality = std::stod(value);
 			else if (name == "maxVideoSize") maxVideoSize = std::stod(value);
+			else if (name == "ffmpegPath") ffmpegPath = value;
+			else if (name == "videoContainer") videoContainer = value;
+			else if (name == "x264preset") x264preset = value;
+			else if (name == "x264crf") x264crf = std::stoi(value);
+			else if (name == "videoLossless") videoLossless = std::stoi(value);
+			else if (name == "encoderThreads") encoderThreads = std::stoi(value);
+			else if (name == "slicedThreads") slicedThreads = std::stoi(value);
 			else if (name == "maxRAM") maxRAM = std::stod(value);
+			else if (name == "debayer") debayer = std::stoi(value);
+			else if (name == "demosaic") demosaic = value;
+			else if (name == "demosaicThreads") demosaicThreads = std::stoi(value);
+			else if (name == "pipelineDepth") pipelineDepth = std::stoi(value);
+			else if (name == "parallelFiles") parallelFiles = std::stoi(value);
+			else if (name == "mappedRead") mappedRead = std::stoi(value);
+			else if (name == "manifest") useManifest = std::stoi(value);
+			else if (name == "followSettleSeconds") followSettleSeconds = std::stoi(value);
+			else if (name == "followExitMinutes") followExitMinutes = std::stoi(value);
+			else if (name == "followMBps") followMBps = std::stoi(value);
+			else if (name == "followBackground") followBackground = std::stoi(value);
+			else if (name.compare(0, 6, "output") == 0 && name.find('.') != string::npos) // outputN.key of a further video
+			{
+				const size_t dot = name.find('.');
+				outputKeys[std::stoi(name.substr(6, dot - 6))][name.substr(dot + 1)] = value;
+			}
 		}
 	}
 	else
@@ -108,130 +239,1263 @@ auto readconfig(string metadata)
 	cout << "h264bitrate=" << h264bitrate << " bps" << endl;
 	cout << "mjpgquality=" << mjpgquality << " %" << endl;
 	cout << "maxVideoSize=" << maxVideoSize << " GB" << endl;
+	if (chosenVideoType == "X264" || chosenVideoType == "FFMJPG")
+	{
+		if (videoContainer != "mkv") videoContainer = "mp4";
+		cout << "ffmpegPath=" << ffmpegPath << ", videoContainer=" << videoContainer << ", x264preset=" << x264preset << ", x264crf=" << x264crf
+			<< ", videoLossless=" << videoLossless << ", encoderThreads=" << encoderThreads << ", slicedThreads=" << slicedThreads << endl;
+	}
 	cout << "maxRAM=" << maxRAM << " GB" << endl;
+	ramBudget.SetLimit(maxRAM > 0 ? static_cast<uint64_t>(maxRAM * 1e9) : 0);
+	if (pipelineDepth < 2) pipelineDepth = 2;
+	cout << "debayer=" << debayer << ", pipelineDepth=" << pipelineDepth << " frames" << endl;
+	if (demosaic != "bilinear" && demosaic != "spinnaker") demosaic = "edge";
+	cout << "demosaic=" << demosaic;
+	if (demosaic != "spinnaker") cout << " (" << Demosaic::IsaName(Demosaic::BestIsa()) << "), demosaicThreads=" << demosaicThreads;
+	cout << endl;
+	cout << "parallelFiles=" << parallelFiles << endl;
+	cout << "mappedRead=" << mappedRead << endl;
+	cout << "manifest=" << useManifest << endl;
+	cout << "followSettleSeconds=" << followSettleSeconds << ", followExitMinutes=" << followExitMinutes << ", followMBps=" << followMBps << ", followBackground=" << followBackground << endl;
+	BuildVideoOutputs();
 	return result, FPS, imageHeight, imageWidth, chosenVideoType, h264bitrate, mjpgquality, maxVideoSize, maxRAM;
 }
 
 /*
 ========================================================================================================================================
-Save2Video coverts the frames-vector to an .avi file.
+SpinnakerPixelFormat maps the pixel format stored in a RODI raw file header to the Spinnaker pixel format.
 ========================================================================================================================================
 */
-int Save2Video(string tempFilename, vector<ImagePtr>& frames)
+PixelFormatEnums SpinnakerPixelFormat(uint32_t pixelFormat)
 {
-	int result = 0;
-	cout << "--- Converting to .AVI ";
+	switch (pixelFormat)
+	{
+	case RODI_PIXEL_MONO8: return PixelFormat_Mono8;
+	case RODI_PIXEL_BAYERGR8: return PixelFormat_BayerGR8;
+	case RODI_PIXEL_BAYERGB8: return PixelFormat_BayerGB8;
+	case RODI_PIXEL_BAYERBG8: return PixelFormat_BayerBG8;
+	default: return PixelFormat_BayerRG8;
+	}
+}
+
+/*
+========================================================================================================================================
+FfmpegVideoOptions returns the settings of the ffmpeg encoder backend (chosenVideoType X264 or FFMJPG) of video for frames of the given
+geometry and RODI pixel format, BGR8 if color is set.
+========================================================================================================================================
+*/
+FfmpegOptions FfmpegVideoOptions(const VideoSettings& video, uint32_t width, uint32_t height, uint32_t pixelFormat, bool color, double frameRate)
+{
+	FfmpegOptions option;
+	option.ffmpegPath = ffmpegPath;
+	option.codec = video.chosenVideoType == "FFMJPG" ? "mjpeg" : "x264";
+	option.container = video.videoContainer;
+	option.preset = video.x264preset;
+	option.crf = video.x264crf;
+	option.bitrate = video.h264bitrate;
+	option.quality = video.mjpgquality;
+	option.lossless = video.videoLossless == 1;
+	option.threads = encoderThreads;
+	option.slicedThreads = slicedThreads == 1;
+	option.maxFileBytes = static_cast<uint64_t>(video.maxVideoSize) * 1000000000ull;
+	option.frameRate = frameRate;
+	option.width = width;
+	option.height = height;
+	switch (color ? RODI_PIXEL_UNKNOWN : pixelFormat)
+	{
+	case RODI_PIXEL_MONO8: option.pixelFormat = "gray"; break;
+	case RODI_PIXEL_BAYERRG8: option.pixelFormat = "bayer_rggb8"; break;
+	case RODI_PIXEL_BAYERGR8: option.pixelFormat = "bayer_grbg8"; break;
+	case RODI_PIXEL_BAYERGB8: option.pixelFormat = "bayer_gbrg8"; break;
+	case RODI_PIXEL_BAYERBG8: option.pixelFormat = "bayer_bggr8"; break;
+	default: option.pixelFormat = "bgr24"; break;
+	}
+	return option;
+}
+
+/*
+========================================================================================================================================
+ConvPipeline streams the frames of one .tmp file from a reader thread through an optional debayer thread to the encoders. A pool of at
+most pipelineDepth frame buffers circulates between the stages through bounded queues, so memory use does not depend on the length of
+the file and reading and debayering overlap with encoding. The pool starts with one buffer and only grows while the encoders lag behind
+and ramBudget has room; otherwise the reader waits for a buffer to come back. A frame is read and debayered once for all videos and goes
+back to the reader when the last video has written it. The scaling buffers of the videos (outputBytes) are reserved with the first frame
+buffer, so one file always holds the minimum it needs to make progress. With a memory-mapped uncompressed file the raw buffers are not
+allocated at all: the images wrap the mapped frames, which stay mapped until the slot is returned.
+========================================================================================================================================
+*/
+struct ConvFrame
+{
+	vector<char> raw; // decoded frame of a compressed file, or the frame as recorded if the file is not mapped
+	RodiFrameView view; // frame as handed out by the reader, points into raw or into the mapped file
+	vector<char> color; // BGR8 frame (debayer = 1)
+	ImagePtr image; // image handed to the encoder, wraps raw or color
+	atomic<int> outputsPending{ 0 }; // videos that have not written the frame yet
+};
+
+struct ConvPipeline
+{
+	ConvPipeline(size_t depth, size_t rawBytes, size_t colorBytes) : maxFrames(depth), frameRawBytes(rawBytes), frameColorBytes(colorBytes),
+		freeFrames(depth), readFrames(depth), encodeFrames(depth), throttled(0)
+	{
+	}
+	~ConvPipeline() { ramBudget.Release(static_cast<uint64_t>(pool.size()) * (frameRawBytes + frameColorBytes) + (pool.empty() ? 0 : outputBytes)); }
+	// GetFreeFrame (reader thread) returns a free buffer, adding one to the pool if the budget allows. Returns nullptr once stopped.
+	ConvFrame* GetFreeFrame()
+	{
+		ConvFrame* frame = nullptr;
+		if (freeFrames.TryPop(frame)) return frame;
+		const uint64_t bytes = frameRawBytes + frameColorBytes;
+		if (pool.size() < maxFrames && (pool.empty() ? (ramBudget.Acquire(bytes + outputBytes), true) : ramBudget.TryAcquire(bytes)))
+		{
+			pool.emplace_back();
+			pool.back().raw.resize(frameRawBytes);
+			pool.back().color.resize(frameColorBytes);
+			return &pool.back();
+		}
+		throttled++; // budget or pipelineDepth reached, wait for the encoder
+		return freeFrames.Pop(frame) ? frame : nullptr;
+	}
+	void Release(ConvFrame* frame) // returns frame to the reader once the last video is done with it
+	{
+		if (--frame->outputsPending > 0) return;
+		frame->image = ImagePtr();
+		frame->view.keepAlive.reset(); // the mapped window may be unmapped once no queued frame uses it
+		freeFrames.Push(frame);
+	}
+	void Fail(const string& message) // records the first error of a stage and stops the pipeline
+	{
+		{
+			lock_guard<mutex> lock(errorMutex);
+			if (error.empty()) error = message;
+		}
+		freeFrames.Close();
+		readFrames.Close();
+		encodeFrames.Close();
+	}
+	const size_t maxFrames;
+	const size_t frameRawBytes;
+	const size_t frameColorBytes;
+	uint64_t outputBytes = 0; // scaling buffers of the videos, set before the reader starts
+	deque<ConvFrame> pool; // frame buffers, owned by the reader thread, reserved in ramBudget
+	BoundedQueue<ConvFrame*> freeFrames; // buffers waiting for the reader
+	BoundedQueue<ConvFrame*> readFrames; // frames waiting for the debayer thread
+	BoundedQueue<ConvFrame*> encodeFrames; // images waiting to be handed to the videos
+	unsigned long long throttled; // times the reader had to wait for a buffer
+	string error;
+	mutex errorMutex;
+};
+
+// ReadFrames runs on the reader thread: it views (and decodes) every frame of rawFile in a free buffer slot and passes it on
+void ReadFrames(RodiRawReader* rawFile, ConvPipeline* pipeline, BoundedQueue<ConvFrame*>* next)
+{
+	const PixelFormatEnums pixelFormat = SpinnakerPixelFormat(rawFile->Header().pixelFormat);
 	try
 	{
-		// creata a new filename
-		string videoFilename = outpath + "\\" + tempFilename.substr(inpath.length() + 1, tempFilename.length() - (inpath.length() + 5));
-		SpinVideo video; // Start and open Spinvideo file
+		for (size_t frameCnt = 0; frameCnt < rawFile->NumFrames(); frameCnt++)
+		{
+			ConvFrame* frame = pipeline->GetFreeFrame();
+			if (frame == nullptr) return; // pipeline stopped
+			if (!rawFile->ViewFrame(frameCnt, frame->view, frame->raw))
+			{
+				pipeline->Fail("could not read frame " + to_string(frameCnt));
+				return;
+			}
+			readThrottle.Acquire(frame->view.frameHeader.payloadSize > 0 ? frame->view.frameHeader.payloadSize : frame->view.size); // followMBps
+			frame->image = Image::Create(rawFile->Width(), rawFile->Height(), 0, 0, pixelFormat, const_cast<char*>(frame->view.data));
+			if (!next->Push(frame)) return;
+		}
+		next->Close();
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		pipeline->Fail(e.what());
+	}
+}
+
+// DebayerFrames runs on the debayer thread (debayer = 1): it converts every Bayer frame to BGR8 in the same buffer slot
+void DebayerFrames(size_t width, size_t height, uint32_t pixelFormat, ConvPipeline* pipeline)
+{
+	Demosaic converter(demosaic == "bilinear" ? DEMOSAIC_BILINEAR : DEMOSAIC_EDGE, demosaicThreads);
+	try
+	{
+		ConvFrame* frame;
+		while (pipeline->readFrames.Pop(frame))
+		{
+			if (pixelFormat != RODI_PIXEL_MONO8)
+			{
+				ImagePtr color = Image::Create(width, height, 0, 0, PixelFormat_BGR8, frame->color.data());
+				if (demosaic == "spinnaker")
+				{
+					frame->image->Convert(color, PixelFormat_BGR8, HQ_LINEAR);
+				}
+				else if (!converter.Convert(reinterpret_cast<const uint8_t*>(frame->view.data), width, static_cast<int>(width), static_cast<int>(height), pixelFormat,
+					reinterpret_cast<uint8_t*>(frame->color.data()), width * 3))
+				{
+					pipeline->Fail("pixel format cannot be demosaiced");
+					return;
+				}
+				frame->image = color;
+			}
+			if (!pipeline->encodeFrames.Push(frame)) return;
+		}
+		pipeline->encodeFrames.Close();
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		pipeline->Fail(e.what());
+	}
+}
+
+/*
+========================================================================================================================================
+VideoOutput writes a video in the chosenVideoType format of its VideoSettings: an .avi file through SpinVideo (MJPG, H264, UNCOMPRESSED) or
+an .mp4/.mkv file through the ffmpeg backend (X264, FFMJPG). Frames are in the recorded pixel format, or BGR8 if color is set.
+========================================================================================================================================
+*/
+struct VideoOutput
+{
+	// Open opens videoFilename (without extension) and logs the format. Returns -1 on failure.
+	int Open(const VideoSettings& video, const string& videoFilename, uint32_t width, uint32_t height, uint32_t pixelFormat, bool color, double frameRate, ostream& log)
+	{
+		const string& chosenVideoType = video.chosenVideoType;
+		useFfmpeg = chosenVideoType == "X264" || chosenVideoType == "FFMJPG";
+		// set the desired compression format (MJPG, H264, UNCOMPRESSED, X264, FFMJPG) and open videofile in that format.	
+		if (useFfmpeg)
+		{
+			if (!ffmpeg.Open(videoFilename, FfmpegVideoOptions(video, width, height, pixelFormat, color, frameRate)))
+			{
+				log << endl << "Failure: " << ffmpeg.Error() << endl;
+				return -1;
+			}
+			log << chosenVideoType << (video.videoLossless == 1 && chosenVideoType == "X264" ? " lossless " : " ");
+			return 0;
+		}
 		// Set maximum video file size in MiB (MebiBytes). A new video file is generated when limit is reached. Setting maximum file size to 0 indicates no limit.
-		const unsigned int k_videoFileSize = maxVideoSize * 3814; //Conversion decimal GigaByte (GB) to binary MebiByte (MiB)
-		video.SetMaximumFileSize(k_videoFileSize);
-		// set the desired compression format (MJPG, H264, UNCOMPRESSED) and open videofile in that format.	
+		const unsigned int k_videoFileSize = video.maxVideoSize * 3814; //Conversion decimal GigaByte (GB) to binary MebiByte (MiB)
+		spin.SetMaximumFileSize(k_videoFileSize);
 		if (chosenVideoType == "MJPG")
 		{
 			Video::MJPGOption option;
-			option.frameRate = FPS;
-			option.quality = mjpgquality;
-			video.Open(videoFilename.c_str(), option);
-			cout << "MJPG ";
+			option.frameRate = frameRate;
+			option.quality = video.mjpgquality;
+			spin.Open(videoFilename.c_str(), option);
+			log << "MJPG ";
 		}
 		else if (chosenVideoType == "H264")
 		{
 			Video::H264Option option;
-			option.frameRate = FPS;
-			option.bitrate = h264bitrate;
-			option.height = static_cast<unsigned int>(frames[0]->GetHeight());
-			option.width = static_cast<unsigned int>(frames[0]->GetWidth());
-			video.Open(videoFilename.c_str(), option);
-			cout << "H264 ";
+			option.frameRate = frameRate;
+			option.bitrate = video.h264bitrate;
+			option.height = static_cast<unsigned int>(height);
+			option.width = static_cast<unsigned int>(width);
+			spin.Open(videoFilename.c_str(), option);
+			log << "H264 ";
 		}
 		else // UNCOMPRESSED
 		{
 			Video::AVIOption option;
-			option.frameRate = FPS;
-			video.Open(videoFilename.c_str(), option);
-			cout << "UNCOMPRESSED ";
+			option.frameRate = frameRate;
+			spin.Open(videoFilename.c_str(), option);
+			log << "UNCOMPRESSED ";
 		}
-		// Build and save video-file.
-		cout << "--- Building video-file " << videoFilename <<" ---";
-		for (int frameCnt = 0; frameCnt < frames.size(); frameCnt++)
+		return 0;
+	}
+	bool Append(const ImagePtr& image)
+	{
+		if (useFfmpeg) return ffmpeg.Append(image->GetData());
+		spin.Append(image);
+		return true;
+	}
+	bool Close()
+	{
+		if (useFfmpeg) return ffmpeg.Close();
+		spin.Close();
+		return true;
+	}
+	string Error() const
+	{
+		return ffmpeg.Error().empty() ? "ffmpeg stopped accepting frames" : ffmpeg.Error();
+	}
+	bool useFfmpeg = false;
+	SpinVideo spin; // Start and open Spinvideo file
+	FfmpegVideo ffmpeg; // or the ffmpeg process
+};
+
+/*
+========================================================================================================================================
+BinBayer2x2 turns a Bayer frame into a BGR8 frame of half its width and height, one pixel per 2x2 cell of the mosaic (red, the mean of the
+two greens, blue). It is the cheap source of the scaled videos when the frames are not debayered. Returns false for other pixel formats.
+========================================================================================================================================
+*/
+bool BinBayer2x2(const uint8_t* src, uint32_t width, uint32_t height, uint32_t pixelFormat, uint8_t* dst)
+{
+	const int red = RodiBayerRedCell(pixelFormat);
+	if (red < 0) return false;
+	const int blue = 3 - red;
+	const int green0 = red == 0 || red == 3 ? 1 : 0;
+	const int green1 = 3 - green0;
+	for (uint32_t y = 0; y + 1 < height; y += 2)
+	{
+		const uint8_t* row0 = src + static_cast<size_t>(y) * width;
+		const uint8_t* row1 = row0 + width;
+		uint8_t* out = dst + static_cast<size_t>(y / 2) * (width / 2) * 3;
+		for (uint32_t x = 0; x + 1 < width; x += 2, out += 3)
+		{
+			const uint8_t cell[4] = { row0[x], row0[x + 1], row1[x], row1[x + 1] };
+			out[0] = cell[blue];
+			out[1] = static_cast<uint8_t>((cell[green0] + cell[green1] + 1) >> 1);
+			out[2] = cell[red];
+		}
+	}
+	return true;
+}
+
+/*
+========================================================================================================================================
+FanOutput is one of the videos Save2Video writes from the frames of a ConvPipeline. Every video has its own writer thread (WriteVideo),
+which scales the frames to the size of the video if needed and encodes them, so the videos of a file are encoded in parallel. A scaled
+video is made from the debayered frames, or from Bayer frames binned 2x2 (BinBayer2x2) when debayer = 0, and is always BGR8 then.
+========================================================================================================================================
+*/
+struct FanOutput
+{
+	explicit FanOutput(size_t depth) : frames(depth) {}
+	VideoSettings settings;
+	VideoOutput video;
+	uint32_t width = 0; // size of the video
+	uint32_t height = 0;
+	bool color = false; // the video is written in BGR8
+	bool scaled = false; // frames are scaled to width x height
+	size_t binnedBytes = 0; // scaling buffers, reserved in ramBudget by the pipeline and allocated by the first scaled frame
+	size_t resizedBytes = 0;
+	vector<char> binned; // Bayer frame binned to half size
+	vector<char> resized; // frame at the size of the video
+	BoundedQueue<ConvFrame*> frames; // frames waiting for this video
+	size_t framesEncoded = 0;
+};
+
+// ScaleFrame returns frame (width x height, recorded pixelFormat or BGR8 if color) at the size of out
+ImagePtr ScaleFrame(const ConvFrame& frame, FanOutput& out, uint32_t width, uint32_t height, uint32_t pixelFormat, bool color)
+{
+	Mat source;
+	if (color) source = Mat(height, width, CV_8UC3, const_cast<char*>(frame.color.data()));
+	else if (pixelFormat == RODI_PIXEL_MONO8) source = Mat(height, width, CV_8UC1, const_cast<char*>(frame.view.data));
+	else
+	{
+		out.binned.resize(out.binnedBytes);
+		BinBayer2x2(reinterpret_cast<const uint8_t*>(frame.view.data), width, height, pixelFormat, reinterpret_cast<uint8_t*>(out.binned.data()));
+		source = Mat(height / 2, width / 2, CV_8UC3, out.binned.data());
+	}
+	out.resized.resize(out.resizedBytes);
+	Mat target(out.height, out.width, source.type(), out.resized.data());
+	if (source.rows == target.rows && source.cols == target.cols) target = source; // Bayer frames at half size need the binning only
+	else resize(source, target, Size(target.cols, target.rows), 0, 0, INTER_AREA);
+	return Image::Create(out.width, out.height, 0, 0, out.color ? PixelFormat_BGR8 : PixelFormat_Mono8, target.data);
+}
+
+// WriteVideo runs on the writer thread of a video: it scales and encodes the frames handed to it and returns them to the pipeline
+void WriteVideo(FanOutput* out, ConvPipeline* pipeline, uint32_t width, uint32_t height, uint32_t pixelFormat, bool color)
+{
+	try
+	{
+		ConvFrame* frame;
+		while (out->frames.Pop(frame))
 		{
-			video.Append(frames[frameCnt]);
+			const bool written = out->video.Append(out->scaled ? ScaleFrame(*frame, *out, width, height, pixelFormat, color) : frame->image);
+			pipeline->Release(frame);
+			if (!written)
+			{
+				out->frames.Close();
+				pipeline->Fail(out->video.Error());
+				return;
+			}
+			out->framesEncoded++;
 		}
-		video.Close(); // Close video file
-		cout << "	Complete!" << endl;
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
+		out->frames.Close();
+		pipeline->Fail(e.what());
+	}
+}
+
+// DiscardOutputs closes the videos of outputs and deletes their files (videoFilename + suffix, with any file numbers) after a failed start
+void DiscardOutputs(deque<FanOutput>& outputs, const string& videoFilename, ostream& log)
+{
+	for (size_t o = 0; o < outputs.size(); o++)
+	{
+		outputs[o].video.Close();
+		const fs::path video(videoFilename + outputs[o].settings.suffix);
+		const vector<string> written = Manifest::FindOutputs(video.parent_path().string(), video.filename().string());
+		for (size_t w = 0; w < written.size(); w++)
+		{
+			boost::system::error_code ec;
+			fs::remove(video.parent_path() / written[w], ec);
+			log << "	removed " << written[w] << endl;
+		}
+	}
+}
+
+/*
+========================================================================================================================================
+Save2Video coverts the frames of an opened .tmp file to the videos of videoOutputs: .avi files (SpinVideo) or .mp4/.mkv files (ffmpeg
+backend, chosenVideoType X264 or FFMJPG), each with its own size, frame decimation and file size limit. The frames are read and debayered
+once and streamed through a ConvPipeline, which hands every frame to the writer threads of the videos that take it. Progress and errors
+go to log, framesEncoded returns the number of frames in the main video.
+========================================================================================================================================
+*/
+int Save2Video(string tempFilename, RodiRawReader& rawFile, double frameRate, ostream& log, size_t& framesEncoded)
+{
+	int result = 0;
+	const uint32_t width = rawFile.Width();
+	const uint32_t height = rawFile.Height();
+	const uint32_t pixelFormat = rawFile.Header().pixelFormat;
+	const bool color = debayer == 1 && pixelFormat != RODI_PIXEL_MONO8;
+	const bool zeroCopy = rawFile.Mapped() && !rawFile.Compressed(); // frames are used in place in the mapped file
+	ConvPipeline pipeline(pipelineDepth, zeroCopy ? 0 : rawFile.FrameBytes(), color ? static_cast<size_t>(width) * height * 3 : 0);
+	framesEncoded = 0;
+	vector<thread> stages;
+	deque<FanOutput> outputs;
+	try
+	{
+		// creata a new filename
+		string videoFilename = outpath + "\\" + tempFilename.substr(inpath.length() + 1, tempFilename.length() - (inpath.length() + 5));
+		for (size_t o = 0; o < videoOutputs.size(); o++)
+		{
+			outputs.emplace_back(pipelineDepth);
+			FanOutput& out = outputs.back();
+			out.settings = videoOutputs[o];
+			out.width = width;
+			out.height = height;
+			if (out.settings.scale < 1) // even sizes, as the encoders subsample the chroma 2x2
+			{
+				out.width = max(2u, static_cast<uint32_t>(width * out.settings.scale) & ~1u);
+				out.height = max(2u, static_cast<uint32_t>(height * out.settings.scale) & ~1u);
+			}
+			out.scaled = out.width != width || out.height != height;
+			out.color = color || (out.scaled && pixelFormat != RODI_PIXEL_MONO8);
+			if (out.scaled)
+			{
+				out.binnedBytes = out.color && !color ? static_cast<size_t>(width / 2) * (height / 2) * 3 : 0;
+				out.resizedBytes = static_cast<size_t>(out.width) * out.height * (out.color ? 3 : 1);
+				pipeline.outputBytes += out.binnedBytes + out.resizedBytes;
+			}
+			const string& type = out.settings.chosenVideoType;
+			log << (o > 0 ? "\n" : "") << "--- Converting to " << (type == "X264" || type == "FFMJPG" ? "." + out.settings.videoContainer : string(".AVI")) << " ";
+			bool opened = false;
+			try
+			{
+				opened = out.video.Open(out.settings, videoFilename + out.settings.suffix, out.width, out.height, pixelFormat, out.color, frameRate / out.settings.decimation, log) == 0;
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				log << endl << "Failure: " << e.what() << endl;
+			}
+			if (!opened)
+			{
+				outputs.pop_back();
+				DiscardOutputs(outputs, videoFilename, log); // no truncated videos of the outputs opened before
+				return -1;
+			}
+			log << "--- Building video-file " << videoFilename + out.settings.suffix;
+			if (out.scaled || out.settings.decimation > 1) log << " (" << out.width << "x" << out.height << ", every " << out.settings.decimation << ". frame)";
+			log << " ---";
+		}
+		// Build and save the videos while the reader (and debayer) threads fill the pipeline.
+		if (debayer == 1)
+		{
+			stages.push_back(thread(ReadFrames, &rawFile, &pipeline, &pipeline.readFrames));
+			stages.push_back(thread(DebayerFrames, width, height, pixelFormat, &pipeline));
+		}
+		else
+		{
+			stages.push_back(thread(ReadFrames, &rawFile, &pipeline, &pipeline.encodeFrames));
+		}
+		for (size_t o = 0; o < outputs.size(); o++)
+		{
+			stages.push_back(thread(WriteVideo, &outputs[o], &pipeline, width, height, pixelFormat, color));
+		}
+		// Hand every frame to the videos that take it (decimation)
+		ConvFrame* frame;
+		for (size_t frameCnt = 0; pipeline.encodeFrames.Pop(frame); frameCnt++)
+		{
+			int takers = 0;
+			for (size_t o = 0; o < outputs.size(); o++)
+			{
+				if (frameCnt % outputs[o].settings.decimation == 0) takers++;
+			}
+			frame->outputsPending = takers > 0 ? takers : 1;
+			if (takers == 0) pipeline.Release(frame);
+			for (size_t o = 0; o < outputs.size(); o++)
+			{
+				if (frameCnt % outputs[o].settings.decimation == 0) outputs[o].frames.Push(frame);
+			}
+		}
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		pipeline.Fail(e.what());
+	}
+	for (size_t o = 0; o < outputs.size(); o++)
+	{
+		outputs[o].frames.Close(); // the writer threads end once their frames are written
+	}
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		stages[i].join();
+	}
+	for (size_t o = 0; o < outputs.size(); o++)
+	{
+		if (!outputs[o].video.Close()) pipeline.Fail(outputs[o].video.Error()); // Close video file
+	}
+	if (!pipeline.error.empty())
+	{
+		log << endl << "Failure: " << pipeline.error << endl;
 		return -1;
 	}
+	framesEncoded = outputs.empty() ? 0 : outputs[0].framesEncoded;
+	log << "	Complete! (" << framesEncoded << " frames";
+	for (size_t o = 0; o < outputs.size(); o++)
+	{
+		if (o > 0) log << ", " << outputs[o].settings.suffix << ": " << outputs[o].framesEncoded << " frames";
+		if (outputs[o].video.useFfmpeg && outputs[o].video.ffmpeg.Files() > 1) log << " in " << outputs[o].video.ffmpeg.Files() << " files";
+	}
+	log << ", " << pipeline.pool.size() << " frame buffers, reader waited " << pipeline.throttled << " times";
+	if (rawFile.Mapped()) log << ", " << rawFile.WindowsMapped() << " mapped windows" << (zeroCopy ? ", zero-copy" : "");
+	log << ")" << endl;
 	return result;
 }
 
 /*
 ========================================================================================================================================
-FrameRetrieval takes binary data chunks (size = frameSize) from the .tmp file, imports it into the frames-vector in either BayerRG8 or Mono8 format and loads the Save2Video function.
+ConvertFile opens one .tmp file and loads the Save2Video function, which streams its frames in the pixel format given by the file header
+(BayerRG8 for legacy headerless files) to the encoder. Geometry and frame rate come from the file header; the ImageHeight and ImageWidth
+of metadata.txt are only needed for legacy files. A failure only affects this file.
 ========================================================================================================================================
 */
+int ConvertFile(const string& FilePath, ostream& log, size_t& framesEncoded)
+{
+	int result = 0;
+	framesEncoded = 0;
+	try
+	{
+		log << endl << "--- Retrieving frames from: " << FilePath.c_str() << " ---" << endl;
+		RodiRawReader rawFile;
+		if (!rawFile.Open(FilePath, imageWidth, imageHeight)) // open and validate file
+		{
+			log << "Failure: could not open file or file holds no complete frame! " << FilePath.c_str() << endl;
+			return -1;
+		}
+		log << "	" << rawFile.Describe() << endl;
+		if (mappedRead == 1 && !rawFile.Map()) log << "	memory mapping failed, reading with fread" << endl;
+		// Frames are read through the seek table and streamed to the encoder
+		const double frameRate = FPS > 0 ? FPS : rawFile.Header().fps; // Framerate of metadata.txt overrides the recorded frame rate
+		result = Save2Video(FilePath, rawFile, frameRate, log, framesEncoded); //converting the frames into .avi
+		if (rawFile.Compressed()) log << "	" << rawFile.DecodeStats() << endl;
+		rawFile.Close(); // Close .tmp file
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		log << "Failure: " << e.what() << endl;
+		result = -1;
+	}
+	catch (std::exception& e)
+	{
+		log << "Failure: " << e.what() << endl;
+		result = -1;
+	}
+	return result;
+}
+
+/*
+========================================================================================================================================
+ConversionParameters returns the settings that change the videos written for a .tmp file, as recorded in the manifest. Settings that
+only change the speed (threads, pipelineDepth, mappedRead, maxRAM) are left out, so changing them does not convert the files again.
+Further videos (outputN) are appended to the settings of the main video.
+========================================================================================================================================
+*/
+string ConversionParameters()
+{
+	stringstream ss;
+	for (size_t o = 0; o < videoOutputs.size(); o++)
+	{
+		const VideoSettings& video = videoOutputs[o];
+		if (o > 0) ss << ";output" << o << ":suffix=" << video.suffix << ";scale=" << video.scale << ";decimation=" << video.decimation << ";";
+		ss << "chosenVideoType=" << video.chosenVideoType << ";Framerate=" << FPS << ";maxVideoSize=" << video.maxVideoSize;
+		if (video.chosenVideoType == "H264" || video.chosenVideoType == "X264") ss << ";h264bitrate=" << video.h264bitrate;
+		if (video.chosenVideoType == "MJPG" || video.chosenVideoType == "FFMJPG") ss << ";mjpgquality=" << video.mjpgquality;
+		if (video.chosenVideoType == "X264" || video.chosenVideoType == "FFMJPG")
+		{
+			ss << ";videoContainer=" << video.videoContainer;
+			if (video.chosenVideoType == "X264") ss << ";x264preset=" << video.x264preset << ";x264crf=" << video.x264crf << ";videoLossless=" << video.videoLossless;
+		}
+	}
+	ss << ";debayer=" << debayer;
+	if (debayer == 1) ss << ";demosaic=" << demosaic;
+	ss << ";ImageWidth=" << imageWidth << ";ImageHeight=" << imageHeight; // geometry of legacy headerless files
+	return ss.str();
+}
+
+/*
+========================================================================================================================================
+FrameRetrieval converts all .tmp files, parallelFiles at a time on a WorkStealingScheduler (largest files first). Files that fail are
+reported at the end and do not stop the batch. Returns -1 if any file failed. With useManifest, files that the manifest of the output
+folder lists as converted with the same parameters are skipped; an interrupted, failed or changed file is converted again from the start
+(a video cannot be continued) and the videos of its earlier conversion are deleted first.
+========================================================================================================================================
+*/
+struct WorkerStats
+{
+	unsigned long long files = 0;
+	unsigned long long failed = 0;
+	unsigned long long frames = 0;
+	uint64_t bytes = 0; // size of the converted .tmp files
+	double seconds = 0; // time spent converting
+};
+
 int FrameRetrieval(vector<string>& filenames, int numFiles)
 {
+	size_t numWorkers = parallelFiles > 0 ? parallelFiles : thread::hardware_concurrency();
+	if (numWorkers > static_cast<size_t>(numFiles)) numWorkers = numFiles;
+	if (numWorkers < 1) numWorkers = 1;
+	WorkStealingScheduler scheduler(numWorkers);
+	vector<uint64_t> fileBytes(numFiles, 0);
+	vector<ManifestEntry> entries(numFiles);
+	const string parameters = ConversionParameters();
+	if (useManifest == 1 && !manifest.Load(outpath, "RODI_CONV"))
+	{
+		cout << "Failure: could not read " << manifest.Path() << endl;
+		return -1;
+	}
+	int skipped = 0;
+	for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+	{
+		if (useManifest == 1)
+		{
+			string reason;
+			if (manifest.Check(filenames[fileCnt], parameters, entries[fileCnt], reason) == MANIFEST_SKIP)
+			{
+				cout << "	=" << filenames[fileCnt] << " is up to date, skipped" << endl;
+				skipped++;
+				continue;
+			}
+			cout << "	+" << filenames[fileCnt] << " (" << reason << ")" << endl;
+		}
+		boost::system::error_code ec;
+		const uintmax_t size = fs::file_size(filenames[fileCnt], ec);
+		fileBytes[fileCnt] = ec ? 0 : static_cast<uint64_t>(size);
+		scheduler.Add(fileCnt, fileBytes[fileCnt]);
+	}
+	vector<WorkerStats> stats(numWorkers);
+	vector<string> failures;
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	scheduler.Run([&](size_t worker, size_t fileCnt)
+	{
+		stringstream log;
+		size_t frames = 0;
+		const chrono::steady_clock::time_point jobStart = chrono::steady_clock::now();
+		if (useManifest == 1) manifest.Begin(entries[fileCnt], false);
+		const int jobResult = ConvertFile(filenames[fileCnt], log, frames);
+		if (useManifest == 1)
+		{
+			vector<string> outputs;
+			for (size_t o = 0; o < videoOutputs.size(); o++)
+			{
+				const vector<string> found = Manifest::FindOutputs(outpath, fs::path(filenames[fileCnt]).stem().string() + videoOutputs[o].suffix);
+				outputs.insert(outputs.end(), found.begin(), found.end());
+			}
+			if (jobResult == 0) manifest.Finish(entries[fileCnt].source, frames, outputs);
+			else manifest.Fail(entries[fileCnt].source, outputs);
+		}
+		WorkerStats& ws = stats[worker];
+		ws.seconds += chrono::duration<double>(chrono::steady_clock::now() - jobStart).count();
+		ws.files++;
+		ws.frames += frames;
+		ws.bytes += fileBytes[fileCnt];
+		lock_guard<mutex> lock(consoleMutex);
+		cout << log.str();
+		if (jobResult != 0)
+		{
+			ws.failed++;
+			failures.push_back(filenames[fileCnt]);
+		}
+	});
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	// Summary of the batch: throughput per worker and failed files
+	WorkerStats total;
+	cout << endl << "--- Converted " << numFiles - skipped - failures.size() << " of " << numFiles << " files";
+	if (skipped > 0) cout << " (" << skipped << " up to date)";
+	cout << " in " << seconds << " s with " << numWorkers << " worker(s) ---" << endl;
+	for (size_t w = 0; w < numWorkers; w++)
+	{
+		const WorkerStats& ws = stats[w];
+		cout << "	worker " << w << ": " << ws.files << " files (" << scheduler.JobsStolen(w) << " stolen, " << ws.failed << " failed), " << ws.frames << " frames, "
+			<< (ws.seconds > 0 ? ws.frames / ws.seconds : 0) << " frames/s, " << (ws.seconds > 0 ? ws.bytes / 1e6 / ws.seconds : 0) << " MB/s" << endl;
+		total.frames += ws.frames;
+		total.bytes += ws.bytes;
+	}
+	cout << "	total: " << total.frames << " frames, " << (seconds > 0 ? total.frames / seconds : 0) << " frames/s, "
+		<< (seconds > 0 ? total.bytes / 1e6 / seconds : 0) << " MB/s" << endl;
+	for (size_t i = 0; i < failures.size(); i++)
+	{
+		cout << "	failed: " << failures[i] << endl;
+	}
+	return failures.empty() ? 0 : -1;
+}
+
+/*
+========================================================================================================================================
+BenchmarkRead compares the ways of reading the .tmp files in folder: the original loop (ifstream::read into a new char[] per frame),
+RodiRawReader::ReadFrame (fread into a reused buffer) and ViewFrame on the memory-mapped file. Every frame is checksummed, so all paths
+touch all bytes and must agree. The paths run alternately for k_rounds rounds and the best round of each is reported; the first round
+includes reading from disk, later ones mostly the page cache. The original loop cannot decode compressed files and is left out if the
+folder holds any.
+========================================================================================================================================
+*/
+uint64_t FrameChecksum(const char* data, size_t size)
+{
+	uint64_t sum = 0;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		sum += word ^ i;
+	}
+	for (; i < size; i++)
+	{
+		sum += static_cast<unsigned char>(data[i]) ^ i;
+	}
+	return sum;
+}
+
+int BenchmarkRead(string folder)
+{
+	const int k_rounds = 3;
+	vector<string> files;
+	for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator(); i++)
+	{
+		if (!is_directory(i->path()) && i->path().extension() == ".tmp") files.push_back(i->path().string());
+	}
+	sort(files.begin(), files.end());
+	const int k_ifstream = 0, k_fread = 1, k_mapped = 2; // ways of reading
+	double bestSeconds[3] = { 0, 0, 0 };
+	uint64_t checksum[3] = { 0, 0, 0 };
+	bool ifstreamRead = true; // no compressed file, the original loop can read them all
+	unsigned long long frames = 0;
+	uint64_t bytes = 0;
+	for (int round = 0; round < k_rounds; round++)
+	{
+		for (int path = ifstreamRead ? k_ifstream : k_fread; path <= k_mapped; path++)
+		{
+			const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			vector<char> buffer;
+			RodiFrameView view;
+			checksum[path] = 0;
+			frames = 0;
+			bytes = 0;
+			for (size_t f = 0; f < files.size(); f++)
+			{
+				RodiRawReader rawFile;
+				if (!rawFile.Open(files[f], imageWidth, imageHeight))
+				{
+					if (round == 0 && path == k_ifstream) cout << "	skipped " << files[f] << " (no complete frame)" << endl;
+					continue;
+				}
+				if (path == k_ifstream)
+				{
+					if (rawFile.Compressed())
+					{
+						cout << "	" << files[f] << " is compressed, the ifstream loop is left out" << endl;
+						ifstreamRead = false;
+						break;
+					}
+					// the loop RODI_CONV used to read the frames with, at the frame offsets of the seek table
+					const size_t frameSize = rawFile.FrameBytes();
+					const uint64_t headerBytes = rawFile.IsLegacy() ? 0 : sizeof(RodiFrameHeader);
+					ifstream stream(files[f].c_str(), ios_base::in | ios_base::binary);
+					for (size_t i = 0; i < rawFile.NumFrames() && stream.good(); i++)
+					{
+						char* frameBuffer = new char[frameSize];
+						stream.seekg(static_cast<streamoff>(rawFile.FrameOffset(i) + headerBytes));
+						stream.read(frameBuffer, frameSize);
+						checksum[path] += FrameChecksum(frameBuffer, frameSize);
+						delete[] frameBuffer;
+						frames++;
+						bytes += frameSize;
+					}
+					if (!stream.good())
+					{
+						cout << "Failure: could not read " << files[f] << " with ifstream" << endl;
+						return -1;
+					}
+					continue;
+				}
+				if (path == k_mapped && !rawFile.Map())
+				{
+					cout << "Failure: could not map " << files[f] << endl;
+					return -1;
+				}
+				for (size_t i = 0; i < rawFile.NumFrames(); i++)
+				{
+					if (!rawFile.ViewFrame(i, view, buffer))
+					{
+						cout << "Failure: could not read frame " << i << " of " << files[f] << endl;
+						return -1;
+					}
+					checksum[path] += FrameChecksum(view.data, view.size);
+					frames++;
+					bytes += view.size;
+				}
+				view.keepAlive.reset();
+			}
+			const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			if (round == 0 || seconds < bestSeconds[path]) bestSeconds[path] = seconds;
+		}
+	}
+	const char* names[3] = { "ifstream", "fread   ", "mapped  " };
+	cout << files.size() << " files, " << frames << " frames, " << bytes / 1000000 << " MB per pass, best of " << k_rounds << " rounds" << endl;
+	for (int path = ifstreamRead ? k_ifstream : k_fread; path <= k_mapped; path++)
+	{
+		const double seconds = bestSeconds[path];
+		cout << "	" << names[path] << ": " << seconds << " s, " << (seconds > 0 ? frames / seconds : 0) << " frames/s, "
+			<< (seconds > 0 ? bytes / 1e6 / seconds : 0) << " MB/s" << endl;
+	}
+	if (checksum[k_mapped] != checksum[k_fread] || (ifstreamRead && checksum[k_ifstream] != checksum[k_fread]))
+	{
+		cout << "Failure: the frames differ between the ways of reading" << endl;
+		return -1;
+	}
+	cout << "	checksums match" << endl;
+	return 0;
+}
+/*
+========================================================================================================================================
+ValidateDemosaic checks the native demosaicing against Demosaic::Reference on the first k_frames frames of every Bayer .tmp file in
+folder, for both methods and every instruction set this processor supports, and reports the time per frame next to Spinnaker HQ_LINEAR.
+Any difference to the reference fails the validation.
+========================================================================================================================================
+*/
+int ValidateDemosaic(string folder)
+{
+	const size_t k_frames = 5;
+	vector<string> files;
+	for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator(); i++)
+	{
+		if (!is_directory(i->path()) && i->path().extension() == ".tmp") files.push_back(i->path().string());
+	}
+	sort(files.begin(), files.end());
+	const int numIsa = Demosaic::BestIsa() + 1;
+	vector<double> ms(2 * numIsa, 0); // time per method and instruction set
+	double spinnakerMs = 0;
+	unsigned long long frames = 0, mismatches = 0;
+	vector<char> buffer;
+	RodiFrameView view;
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		RodiRawReader rawFile;
+		if (!rawFile.Open(files[f], imageWidth, imageHeight) || rawFile.Header().pixelFormat == RODI_PIXEL_MONO8) continue;
+		const int width = rawFile.Width();
+		const int height = rawFile.Height();
+		const size_t stride = static_cast<size_t>(width) * 3;
+		vector<uint8_t> reference(stride * height), converted(stride * height);
+		for (size_t i = 0; i < rawFile.NumFrames() && i < k_frames; i++)
+		{
+			if (!rawFile.ViewFrame(i, view, buffer)) break;
+			const uint8_t* raw = reinterpret_cast<const uint8_t*>(view.data);
+			for (int method = 0; method < 2; method++)
+			{
+				Demosaic::Reference(raw, width, width, height, view.pixelFormat, reference.data(), stride, static_cast<DemosaicMethod>(method));
+				for (int isa = 0; isa < numIsa; isa++)
+				{
+					Demosaic converter(static_cast<DemosaicMethod>(method), demosaicThreads, static_cast<DemosaicIsa>(isa));
+					const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+					converter.Convert(raw, width, width, height, view.pixelFormat, converted.data(), stride);
+					ms[method * numIsa + isa] += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+					if (converted != reference)
+					{
+						mismatches++;
+						cout << "	mismatch: " << Demosaic::MethodName(static_cast<DemosaicMethod>(method)) << " " << Demosaic::IsaName(static_cast<DemosaicIsa>(isa))
+							<< ", frame " << i << " of " << files[f] << endl;
+					}
+				}
+			}
+			ImagePtr pImage = Image::Create(width, height, 0, 0, SpinnakerPixelFormat(view.pixelFormat), const_cast<char*>(view.data));
+			ImagePtr color = Image::Create(width, height, 0, 0, PixelFormat_BGR8, converted.data());
+			const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			pImage->Convert(color, PixelFormat_BGR8, HQ_LINEAR);
+			spinnakerMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			frames++;
+		}
+		view.keepAlive.reset();
+	}
+	if (frames == 0)
+	{
+		cout << "Failure: no Bayer frames found" << endl;
+		return -1;
+	}
+	cout << frames << " frames, " << (demosaicThreads > 0 ? demosaicThreads : thread::hardware_concurrency()) << " thread(s) per frame" << endl;
+	for (int method = 0; method < 2; method++)
+	{
+		for (int isa = 0; isa < numIsa; isa++)
+		{
+			cout << "	" << Demosaic::MethodName(static_cast<DemosaicMethod>(method)) << " " << Demosaic::IsaName(static_cast<DemosaicIsa>(isa)) << ": "
+				<< ms[method * numIsa + isa] / frames << " ms per frame" << endl;
+		}
+	}
+	cout << "	Spinnaker HQ_LINEAR: " << spinnakerMs / frames << " ms per frame" << endl;
+	if (mismatches > 0)
+	{
+		cout << "Failure: " << mismatches << " conversions differ from the reference" << endl;
+		return -1;
+	}
+	cout << "	all conversions match the reference" << endl;
+	return 0;
+}
+/*
+========================================================================================================================================
+BenchmarkEncode measures the encoding speed of the SpinVideo path (MJPG, H264) and of the ffmpeg backend (X264, X264 lossless, FFMJPG)
+on the same frames: the first k_frames frames of the first .tmp file in folder are loaded into memory and appended to each encoder. The
+settings of metadata.txt apply; the test videos are written to folder and deleted afterwards.
+========================================================================================================================================
+*/
+int BenchmarkEncode(string folder)
+{
+	const size_t k_frames = 200;
+	RodiRawReader rawFile;
+	for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator() && rawFile.NumFrames() == 0; i++)
+	{
+		if (!is_directory(i->path()) && i->path().extension() == ".tmp") rawFile.Open(i->path().string(), imageWidth, imageHeight);
+	}
+	if (rawFile.NumFrames() == 0)
+	{
+		cout << "Failure: no .tmp file with frames found" << endl;
+		return -1;
+	}
+	cout << rawFile.Describe() << endl;
+	vector<vector<char>> frames;
+	for (size_t i = 0; i < rawFile.NumFrames() && i < k_frames; i++)
+	{
+		frames.emplace_back();
+		rawFile.ReadFrame(i, frames.back());
+	}
+	const uint32_t width = rawFile.Width();
+	const uint32_t height = rawFile.Height();
+	const uint32_t pixelFormat = rawFile.Header().pixelFormat;
+	const double frameRate = FPS > 0 ? FPS : rawFile.Header().fps > 0 ? rawFile.Header().fps : 25;
+	const string base = (fs::path(folder) / "benchmark_encode").string();
+	const char* encoders[] = { "SpinVideo MJPG", "SpinVideo H264", "ffmpeg X264", "ffmpeg X264 lossless", "ffmpeg FFMJPG" };
 	int result = 0;
-	int frameSize = imageHeight * imageWidth;
-	try 
+	for (int e = 0; e < 5; e++)
 	{
-		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++) // for-loop going over each .tmp file
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		string failure;
+		try
 		{
-			string FilePath = filenames.at(fileCnt);
-			cout << endl << "--- Retrieving frames from: " << FilePath.c_str() << " ---" << endl;
-			ifstream rawFile(filenames.at(fileCnt).c_str(), ios_base::in | ios_base::binary);
-			if (!rawFile) // check-file
+			if (e < 2)
 			{
-				cout << endl << "Could not open file! " << filenames.at(fileCnt).c_str() << "Press enter to exit." << endl;
-				getchar();
-				return -1;
+				SpinVideo video;
+				if (e == 0)
+				{
+					Video::MJPGOption option;
+					option.frameRate = frameRate;
+					option.quality = mjpgquality;
+					video.Open(base.c_str(), option);
+				}
+				else
+				{
+					Video::H264Option option;
+					option.frameRate = frameRate;
+					option.bitrate = h264bitrate;
+					option.height = height;
+					option.width = width;
+					video.Open(base.c_str(), option);
+				}
+				for (size_t i = 0; i < frames.size(); i++)
+				{
+					video.Append(Image::Create(width, height, 0, 0, SpinnakerPixelFormat(pixelFormat), frames[i].data()));
+				}
+				video.Close();
+			}
+			else
+			{
+				FfmpegOptions option = FfmpegVideoOptions(videoOutputs[0], width, height, pixelFormat, false, frameRate);
+				option.codec = e == 4 ? "mjpeg" : "x264";
+				option.lossless = e == 3;
+				option.maxFileBytes = 0;
+				FfmpegVideo video;
+				bool ok = video.Open(base, option);
+				for (size_t i = 0; ok && i < frames.size(); i++)
+				{
+					ok = video.Append(frames[i].data());
+				}
+				if (!video.Close() || !ok) failure = video.Error().empty() ? "ffmpeg stopped accepting frames" : video.Error();
+			}
+		}
+		catch (Spinnaker::Exception& ex)
+		{
+			failure = ex.what();
+		}
+		const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		uint64_t bytes = 0;
+		for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator(); i++)
+		{
+			if (i->path().filename().string().compare(0, 16, "benchmark_encode") != 0) continue;
+			boost::system::error_code ec;
+			bytes += fs::file_size(i->path(), ec);
+			fs::remove(i->path(), ec);
+		}
+		cout << "	" << encoders[e] << ": ";
+		if (!failure.empty())
+		{
+			cout << "Failure: " << failure << endl;
+			result = -1;
+			continue;
+		}
+		cout << frames.size() / seconds << " frames/s, " << bytes / 1e6 << " MB (" << (bytes > 0 ? static_cast<double>(frames.size()) * rawFile.FrameBytes() / bytes : 0)
+			<< " x smaller than raw)" << endl;
+	}
+	return result;
+}
+/*
+========================================================================================================================================
+ExtractClip exports the frames first .. last of one .tmp file, selected by frame number (by = index), camera FrameID (frameid), camera
+timestamp (timestamp) or system time (systime) as logged by RODI_REC. Frame numbers come straight from the seek table, FrameIDs and
+timestamps by bisecting the frame headers, system times from the .idx frame index, so no part of the file outside the clip is read.
+The system time of RODI_REC counts nanoseconds from the last 00:00, 08:00 or 16:00 UTC and wraps every 8 hours: a range across the wrap
+cannot be selected by systime (first must not be after last), it has to be exported as two clips or by frameid or timestamp.
+An output ending in .png, .tif, .tiff, .jpg or .bmp writes an image sequence (<output>_<frame>.png, debayered), any other output a video
+in the chosenVideoType format (debayered with debayer = 1).
+========================================================================================================================================
+*/
+int ExtractClip(string path, string by, uint64_t first, uint64_t last, string output)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	RodiRawReader rawFile;
+	if (!rawFile.Open(path, imageWidth, imageHeight))
+	{
+		cout << "Failure: could not open file or file holds no complete frame! " << path << endl;
+		return -1;
+	}
+	rawFile.Map();
+	if (first > last)
+	{
+		cout << "Failure: the first frame of the clip is after the last" << (by == "systime" ? " (system times wrap every 8 hours, split the clip at the wrap)" : "") << endl;
+		return -1;
+	}
+	// find the frame range [begin, end) of the clip
+	size_t begin = rawFile.NumFrames();
+	size_t end = begin;
+	if (by == "index")
+	{
+		begin = first < rawFile.NumFrames() ? static_cast<size_t>(first) : rawFile.NumFrames();
+		end = last < rawFile.NumFrames() ? static_cast<size_t>(last) + 1 : rawFile.NumFrames();
+	}
+	else if (by == "frameid" || by == "timestamp")
+	{
+		begin = rawFile.FindFrame(first, by == "timestamp");
+		end = last == UINT64_MAX ? rawFile.NumFrames() : rawFile.FindFrame(last + 1, by == "timestamp");
+	}
+	else if (by == "systime")
+	{
+		FrameIndexHeader indexHeader;
+		vector<FrameIndexRecord> records;
+		if (!ReadFrameIndex(fs::path(path).replace_extension(".idx").string(), indexHeader, records))
+		{
+			cout << "Failure: selecting by system time needs the .idx frame index next to " << path << endl;
+			return -1;
+		}
+		for (size_t r = 0; r < records.size(); r++)
+		{
+			if (records[r].flags & k_rodiFrameDiscarded) continue;
+			const int64_t t = records[r].hostTimestamp;
+			if (t < static_cast<int64_t>(first) || t > static_cast<int64_t>(last)) continue;
+			const size_t frame = rawFile.FrameAtOffset(records[r].byteOffset);
+			if (frame == rawFile.NumFrames()) continue;
+			if (begin == rawFile.NumFrames() || frame < begin) begin = frame;
+			if (end == rawFile.NumFrames() || frame + 1 > end) end = frame + 1;
+		}
+	}
+	else
+	{
+		cout << "Failure: select frames by index, frameid, timestamp or systime" << endl;
+		return -1;
+	}
+	if (begin >= end)
+	{
+		cout << "Failure: no frames in the selected range" << endl;
+		return -1;
+	}
+	// image sequence or video
+	string extension = fs::path(output).extension().string();
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	const bool images = extension == ".png" || extension == ".tif" || extension == ".tiff" || extension == ".jpg" || extension == ".bmp";
+	const string stem = fs::path(output).replace_extension().string();
+	const uint32_t width = rawFile.Width();
+	const uint32_t height = rawFile.Height();
+	const uint32_t pixelFormat = rawFile.Header().pixelFormat;
+	const bool color = (images || debayer == 1) && pixelFormat != RODI_PIXEL_MONO8;
+	Demosaic converter(demosaic == "bilinear" ? DEMOSAIC_BILINEAR : DEMOSAIC_EDGE, demosaicThreads);
+	Mat colorFrame(height, width, CV_8UC3);
+	vector<char> buffer;
+	RodiFrameView view;
+	VideoOutput video;
+	stringstream log;
+	int result = 0;
+	try
+	{
+		if (!images && video.Open(videoOutputs[0], stem, width, height, pixelFormat, color, FPS > 0 ? FPS : rawFile.Header().fps, log) != 0)
+		{
+			cout << log.str();
+			return -1;
+		}
+		for (size_t i = begin; i < end && result == 0; i++)
+		{
+			if (!rawFile.ViewFrame(i, view, buffer))
+			{
+				cout << "Failure: could not read frame " << i << endl;
+				result = -1;
+				break;
+			}
+			Mat raw(height, width, CV_8UC1, const_cast<char*>(view.data));
+			if (color) converter.Convert(raw.data, raw.step, width, height, pixelFormat, colorFrame.data, colorFrame.step);
+			if (images)
+			{
+				stringstream name;
+				name << stem << "_" << setw(6) << setfill('0') << i << extension;
+				if (!imwrite(name.str(), color ? colorFrame : raw))
+				{
+					cout << "Failure: could not write " << name.str() << endl;
+					result = -1;
+				}
 			}
-			// Frame retrieval from .tmp files. Binary data chunks (size = frameSize) are taken and imported into the frames-vector.
-			vector<ImagePtr> frames; // Create an empty frames vector of ImagePointer objects
-			int frameCnt = 0; // set frameCnt to zero
-			while (rawFile.good() && frameCnt < 1000)
+			else if (!video.Append(color ? Image::Create(width, height, 0, 0, PixelFormat_BGR8, colorFrame.data)
+				: Image::Create(width, height, 0, 0, SpinnakerPixelFormat(pixelFormat), raw.data)))
 			{
-				// Reading frames from .tmp file
-				char* frameBuffer = new char[frameSize];
-				rawFile.read(frameBuffer, frameSize); //Extracts frameSize characters from the .tmp file and assigns it to frameBuffer
-				ImagePtr pImage = Image::Create(imageWidth, imageHeight, 0, 0, PixelFormat_BayerRG8, frameBuffer);
-				frames.push_back(pImage->Convert(PixelFormat_BayerRG8, HQ_LINEAR));
-				delete[] frameBuffer; // delete frameBuffer
-				frameCnt++; // update frame counter
+				cout << "Failure: " << video.Error() << endl;
+				result = -1;
 			}
-			result = Save2Video(FilePath, frames); //converting frames-vector into .avi
-			rawFile.close(); // Close .tmp file
+		}
+		if (!images && !video.Close() && result == 0)
+		{
+			cout << "Failure: " << video.Error() << endl;
+			result = -1;
 		}
 	}
 	catch (Spinnaker::Exception& e)
 	{
 		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
+		result = -1;
+	}
+	if (result != 0) return result;
+	RodiFrameHeader firstHeader, lastHeader;
+	view.keepAlive.reset();
+	rawFile.ViewFrame(begin, view, buffer);
+	firstHeader = view.frameHeader;
+	rawFile.ViewFrame(end - 1, view, buffer);
+	lastHeader = view.frameHeader;
+	cout << "	frames " << begin << " - " << end - 1 << " (" << end - begin << " frames, FrameID " << firstHeader.frameID << " - " << lastHeader.frameID
+		<< ", timestamp " << firstHeader.timestamp << " - " << lastHeader.timestamp << ")" << endl;
+	cout << "	" << (images ? "images " + stem + "_*" + extension : log.str() + "video " + stem) << " written in "
+		<< chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+	return 0;
+}
+
+/*
+========================================================================================================================================
+Follow converts the recording in inpath while RODI_REC is still writing it: every .tmp file is converted as soon as RODI_REC has finalized
+it (FolderWatcher), instead of after the whole recording. The process runs with low CPU and I/O priority (followBackground) and reads at
+most followMBps, so it never holds up the acquisition on the same machine. The manifest makes sure a file is converted only once, also
+when follow mode is restarted. Runs until closed, or until no new file was finalized for followExitMinutes.
+========================================================================================================================================
+*/
+int Follow()
+{
+	const int k_pollMs = 5000; // longest wait between two listings of the folder
+	int result = 0;
+	if (followBackground == 1 && !EnterBackgroundMode()) cout << "	could not lower the process priority" << endl;
+	readThrottle.SetLimit(static_cast<uint64_t>(followMBps) * 1000000ull);
+	useManifest = 1;
+	FolderWatcher watcher;
+	if (!fs::is_directory(outpath))
+	{
+		cout << "Failure: output folder " << outpath << " does not exist" << endl;
+		return -1;
+	}
+	if (!watcher.Open(inpath, followSettleSeconds))
+	{
+		cout << "Failure: could not watch " << inpath << endl;
 		return -1;
 	}
+	cout << endl << "--- Following " << inpath << (watcher.Notified() ? "" : " (polling)") << ", converting to " << outpath << " ---" << endl;
+	chrono::steady_clock::time_point lastFile = chrono::steady_clock::now();
+	while (true)
+	{
+		vector<string> ready = watcher.ReadyFiles();
+		if (!ready.empty())
+		{
+			cout << endl << "--- " << ready.size() << " finalized .tmp file(s) ---" << endl;
+			if (FrameRetrieval(ready, ready.size()) != 0) result = -1;
+			lastFile = chrono::steady_clock::now();
+			continue; // list again right away, more files may have been finalized during the conversion
+		}
+		if (followExitMinutes > 0 && chrono::steady_clock::now() - lastFile >= chrono::minutes(followExitMinutes))
+		{
+			cout << endl << "--- No new .tmp file for " << followExitMinutes << " minutes, follow mode ends ---" << endl;
+			break;
+		}
+		watcher.Wait(k_pollMs);
+	}
 	return result;
 }
 
-
 /*
 ========================================================================================================================================
 Main function of the script. In here input and output folders are defined, metadata.txt file loaded and the conversion process started.
 ========================================================================================================================================
 */
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
 	int result = 0;
+	BuildVideoOutputs(); // main video with the default settings, until metadata.txt is read
+	// RODI_CONV --benchmark-read <folder> [<metadata.txt>] compares ifstream, fread and memory-mapped reading of the .tmp files in folder
+	// and exits
+	if ((argc == 3 || argc == 4) && string(argv[1]) == "--benchmark-read")
+	{
+		if (argc == 4) readconfig(argv[3]); // ImageWidth and ImageHeight of legacy headerless files
+		cout << endl << "--- Benchmarking .tmp file reading in " << argv[2] << " ---" << endl;
+		return BenchmarkRead(argv[2]);
+	}
+	// RODI_CONV --validate-demosaic <folder> [<metadata.txt>] validates and times the native demosaicing on the .tmp files in folder and exits
+	if ((argc == 3 || argc == 4) && string(argv[1]) == "--validate-demosaic")
+	{
+		if (argc == 4) readconfig(argv[3]);
+		cout << endl << "--- Validating demosaicing on " << argv[2] << " ---" << endl;
+		return ValidateDemosaic(argv[2]);
+	}
+	// RODI_CONV --benchmark-encode <folder> <metadata.txt> compares the encoding speed of SpinVideo and the ffmpeg backend and exits
+	if (argc == 4 && string(argv[1]) == "--benchmark-encode")
+	{
+		readconfig(argv[3]);
+		cout << endl << "--- Benchmarking the video encoders on " << argv[2] << " ---" << endl;
+		return BenchmarkEncode(argv[2]);
+	}
+	// RODI_CONV --clip <file.tmp> <index|frameid|timestamp|systime> <first> <last> <output> [<metadata.txt>] exports a clip and exits
+	if ((argc == 7 || argc == 8) && string(argv[1]) == "--clip")
+	{
+		if (argc == 8) readconfig(argv[7]);
+		cout << endl << "--- Extracting " << argv[2] << " " << argv[3] << " " << argv[4] << " - " << argv[5] << " ---" << endl;
+		return ExtractClip(argv[2], argv[3], stoull(argv[4]), stoull(argv[5]), argv[6]);
+	}
+	// RODI_CONV --follow <input folder> <output folder> <metadata.txt> converts the .tmp files while they are being recorded
+	if (argc == 5 && string(argv[1]) == "--follow")
+	{
+		inpath = argv[2];
+		outpath = argv[3];
+		readconfig(argv[4]);
+		return Follow();
+	}
 	// Print application build information
 	cout << "*************************************************************" << endl;
 	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
@@ -263,7 +1527,7 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 	fs::path p(inpath);
 	for (auto i = fs::directory_iterator(p); i != fs::directory_iterator(); i++)
 	{
-		if (!is_directory(i->path()))
+		if (!is_directory(i->path()) && i->path().extension() == ".tmp") // only the recordings, not the frame indexes, logs or outputs next to them
 		{
 			filenames.push_back(i->path().string());
 		}
@@ -299,6 +1563,9 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 	getchar(); 
 	// Start conversion process
 	result = FrameRetrieval(filenames, numFiles);
+	cout << endl << "--- Peak frame buffer memory: " << ramBudget.Peak() / 1000000 << " MB";
+	if (ramBudget.Limit() > 0) cout << " of " << maxRAM << " GB maxRAM, " << ramBudget.Denied() << " buffer requests held back";
+	cout << " ---" << endl;
 	// ASCII logo: http://patorjk.com/software/taag/#p=display&h=3&v=2&f=Slant%20Relief&t=RODI_conv
 	std::cout << R"(  
 
@@ -317,7 +1584,8 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 	cout << "*************************************************************" << endl;
 	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
 	cout << "*************************************************************" << endl;
-	cout << endl << "All files were succesfully converted! Press enter to exit." << endl;
+	if (result == 0) cout << endl << "All files were succesfully converted! Press enter to exit." << endl;
+	else cout << endl << "Some files could not be converted, see the failures above. Press enter to exit." << endl;
 	getchar();
 	return result;
 }
@@ -0,0 +1,124 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Recording script)
+// AcquisitionStats collects the telemetry of one camera pipeline: frames grabbed, frames dropped (gaps in the camera FrameID), incomplete
+// images, frames written (and discarded by the motion trigger), the fill of the camera stream buffers, a histogram of the time the writer
+// thread needs per frame and the compression ratio and time per frame. The grab thread and the writer thread each update their own
+// counters, the compression workers share theirs, a reporting thread reads them without locks.
+//========================================================================================================================================
+
+#include <atomic>
+#include <cstdint>
+
+class AcquisitionStats
+{
+public:
+	static const int k_latencyBuckets = 8;
+
+	AcquisitionStats() { Reset(); }
+
+	void Reset()
+	{
+		grabbed = 0;
+		dropped = 0;
+		incomplete = 0;
+		written = 0;
+		discarded = 0;
+		motion = 0;
+		bufferFill = -1;
+		worstWriteNs = 0;
+		lastFrameID = 0;
+		compressedFrames = 0;
+		rawBytes = 0;
+		packedBytes = 0;
+		compressNs = 0;
+		for (int i = 0; i < k_latencyBuckets; i++)
+		{
+			latency[i] = 0;
+		}
+	}
+
+	// Grab thread: counts a frame and the frames missing between it and the previous FrameID.
+	void FrameGrabbed(uint64_t frameID, bool isIncomplete)
+	{
+		const unsigned long long n = grabbed.load(std::memory_order_relaxed);
+		if (n > 0 && frameID > lastFrameID + 1) dropped.store(dropped.load(std::memory_order_relaxed) + (frameID - lastFrameID - 1), std::memory_order_relaxed);
+		lastFrameID = frameID;
+		if (isIncomplete) incomplete.store(incomplete.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		grabbed.store(n + 1, std::memory_order_relaxed);
+	}
+
+	// Grab thread: number of filled camera stream buffers waiting to be grabbed (-1 if the source cannot tell).
+	void StreamBufferFill(long long buffers) { bufferFill.store(buffers, std::memory_order_relaxed); }
+
+	// Writer thread: counts a written frame and the time it took to write it.
+	void FrameWritten(long long ns)
+	{
+		int bucket = 0;
+		while (bucket < k_latencyBuckets - 1 && ns >= LatencyLimitMs(bucket) * 1000000) bucket++;
+		latency[bucket].store(latency[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (ns > worstWriteNs.load(std::memory_order_relaxed)) worstWriteNs.store(ns, std::memory_order_relaxed);
+		written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Writer thread: counts a frame the motion trigger did not store.
+	void FrameDiscarded() { discarded.store(discarded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+	// Writer thread: counts a frame in which the motion trigger detected activity.
+	void MotionDetected() { motion.store(motion.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+	// Compression workers: counts a compressed frame (packed = raw if the frame was stored uncompressed) and the time it took.
+	void FrameCompressed(size_t raw, size_t packed, long long ns)
+	{
+		compressedFrames.fetch_add(1, std::memory_order_relaxed);
+		rawBytes.fetch_add(raw, std::memory_order_relaxed);
+		packedBytes.fetch_add(packed, std::memory_order_relaxed);
+		compressNs.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	unsigned long long Grabbed() const { return grabbed.load(std::memory_order_relaxed); }
+	unsigned long long Dropped() const { return dropped.load(std::memory_order_relaxed); }
+	unsigned long long Incomplete() const { return incomplete.load(std::memory_order_relaxed); }
+	unsigned long long Written() const { return written.load(std::memory_order_relaxed); }
+	unsigned long long Discarded() const { return discarded.load(std::memory_order_relaxed); }
+	unsigned long long Motion() const { return motion.load(std::memory_order_relaxed); }
+	long long BufferFill() const { return bufferFill.load(std::memory_order_relaxed); }
+	double WorstWriteMs() const { return worstWriteNs.load(std::memory_order_relaxed) / 1e6; }
+	unsigned long long LatencyCount(int bucket) const { return latency[bucket].load(std::memory_order_relaxed); }
+	unsigned long long CompressedFrames() const { return compressedFrames.load(std::memory_order_relaxed); }
+	double CompressionRatio() const
+	{
+		const unsigned long long packed = packedBytes.load(std::memory_order_relaxed);
+		return packed > 0 ? static_cast<double>(rawBytes.load(std::memory_order_relaxed)) / packed : 0;
+	}
+	double CompressMsPerFrame() const
+	{
+		const unsigned long long frames = CompressedFrames();
+		return frames > 0 ? compressNs.load(std::memory_order_relaxed) / 1e6 / frames : 0;
+	}
+	// upper limit of a latency bucket in milliseconds, the last bucket holds everything slower
+	static int LatencyLimitMs(int bucket)
+	{
+		static const int limits[k_latencyBuckets - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+		return limits[bucket];
+	}
+
+private:
+	AcquisitionStats(const AcquisitionStats&) = delete;
+	AcquisitionStats& operator=(const AcquisitionStats&) = delete;
+
+	std::atomic<unsigned long long> grabbed; // written by the grab thread only
+	std::atomic<unsigned long long> dropped;
+	std::atomic<unsigned long long> incomplete;
+	std::atomic<long long> bufferFill;
+	uint64_t lastFrameID;
+	std::atomic<unsigned long long> written; // written by the writer thread only
+	std::atomic<unsigned long long> discarded;
+	std::atomic<unsigned long long> motion;
+	std::atomic<long long> worstWriteNs;
+	std::atomic<unsigned long long> latency[k_latencyBuckets];
+	std::atomic<unsigned long long> compressedFrames; // updated by all compression workers
+	std::atomic<unsigned long long> rawBytes;
+	std::atomic<unsigned long long> packedBytes;
+	std::atomic<long long> compressNs;
+};
@@ -0,0 +1,111 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Recording script)
+// FrameRing is a preallocated single-producer/single-consumer ring of frame slots. The grab thread copies each camera frame into the
+// next free slot and releases the camera buffer straight away, the writer thread drains the slots to disk. No locks or allocations
+// are used once the ring is created. Optionally a pool of worker threads processes (compresses) the slots between the grab thread and
+// the writer thread: workers claim committed slots in any order, the writer still receives them in grab order.
+//========================================================================================================================================
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct FrameSlot
+{
+	std::vector<char> data; // preallocated frame buffer (frameSize bytes)
+	size_t size = 0; // number of valid bytes in data
+	uint64_t frameID = 0; // camera FrameID
+	uint64_t timestamp = 0; // camera timestamp
+	int64_t hostTimestamp = 0; // system time in nanoseconds when the frame was grabbed
+	int64_t grabTime = 0; // steady clock in nanoseconds when the frame was grabbed, hostTimestamp wraps every 8 hours
+	uint32_t flags = 0; // RodiFrameHeader flags (k_rodiFrameIncomplete, k_rodiFrameRaw)
+	std::vector<uint8_t> packed; // compressed frame, filled by a processing worker
+	std::atomic<bool> processed{ false }; // set by the worker once packed is ready
+};
+
+class FrameRing
+{
+public:
+	FrameRing(size_t depth, size_t frameSize, bool withProcessing = false) : slots(depth < 2 ? 2 : depth), processing(withProcessing), head(0),
+		processHead(0), tail(0), highWater(0)
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			slots[i].data.resize(frameSize);
+		}
+	}
+
+	// Producer side: returns the next free slot or nullptr when the ring is full.
+	FrameSlot* BeginWrite()
+	{
+		const uint64_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= slots.size()) return nullptr;
+		return &slots[h % slots.size()];
+	}
+
+	// Producer side: publishes the slot returned by BeginWrite() to the consumer.
+	void CommitWrite()
+	{
+		slots[head.load(std::memory_order_relaxed) % slots.size()].processed.store(false, std::memory_order_relaxed);
+		const uint64_t h = head.load(std::memory_order_relaxed) + 1;
+		head.store(h, std::memory_order_release);
+		const size_t fill = static_cast<size_t>(h - tail.load(std::memory_order_acquire));
+		if (fill > highWater.load(std::memory_order_relaxed)) highWater.store(fill, std::memory_order_relaxed);
+	}
+
+	// Worker side (any number of threads): claims the oldest committed slot no other worker has claimed, nullptr if there is none.
+	FrameSlot* BeginProcess()
+	{
+		uint64_t p = processHead.load(std::memory_order_relaxed);
+		while (p < head.load(std::memory_order_acquire))
+		{
+			if (processHead.compare_exchange_weak(p, p + 1, std::memory_order_acq_rel)) return &slots[p % slots.size()];
+		}
+		return nullptr;
+	}
+
+	// Worker side: hands a processed slot on to the consumer.
+	void EndProcess(FrameSlot* slot) { slot->processed.store(true, std::memory_order_release); }
+
+	// Consumer side: returns the oldest filled (and processed) slot or nullptr when there is none.
+	FrameSlot* BeginRead()
+	{
+		const uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return nullptr;
+		FrameSlot* slot = &slots[t % slots.size()];
+		if (processing && !slot->processed.load(std::memory_order_acquire)) return nullptr;
+		return slot;
+	}
+
+	// Consumer side: returns the committed slot ahead that is i slots behind the oldest one (processed or not), nullptr if there is none.
+	// The motion trigger looks ahead this way to decide on the pre-roll of the frames waiting in the ring.
+	FrameSlot* Peek(size_t i)
+	{
+		const uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t + i >= head.load(std::memory_order_acquire)) return nullptr;
+		return &slots[(t + i) % slots.size()];
+	}
+
+	// Consumer side: hands the slot returned by BeginRead() back to the producer.
+	void EndRead()
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	size_t Depth() const { return slots.size(); }
+	size_t Occupancy() const { return static_cast<size_t>(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)); }
+	size_t HighWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+
+private:
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	std::vector<FrameSlot> slots;
+	const bool processing; // slots pass through BeginProcess/EndProcess before the consumer sees them
+	alignas(64) std::atomic<uint64_t> head; // written by the grab thread only
+	alignas(64) std::atomic<uint64_t> processHead; // next slot to be claimed by a worker
+	alignas(64) std::atomic<uint64_t> tail; // written by the writer thread only
+	alignas(64) std::atomic<size_t> highWater;
+};
@@ -0,0 +1,296 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Recording script)
+// FrameSource is the interface between the recording pipeline (frame ring, writer thread, .tmp files) and whatever produces the frames.
+// RODI_REC implements it for FLIR cameras (SpinnakerSource). The hardware-free backends below allow benchmarking and regression-testing
+// the recording path without a camera attached:
+//
+//	SyntheticSource		generates Bayer frames of a given resolution at a target FPS (dark objects drifting over a textured background)
+//	ReplaySource		streams existing .tmp files at their recorded rate, accelerated, or as fast as possible
+//
+// A source with pacing disabled (FPS or speed 0) delivers frames as fast as the pipeline accepts them, which measures the maximum
+// sustainable frame rate of the machine and disk (RODI_REC --benchmark).
+//========================================================================================================================================
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include "../RODI_Shared/RodiRawFormat.h"
+
+struct SourceFrame
+{
+	const void* data = nullptr; // frame data, valid until Release()
+	size_t size = 0; // bytes
+	uint64_t frameID = 0; // camera FrameID
+	uint64_t timestamp = 0; // camera timestamp in nanoseconds
+	bool incomplete = false; // the camera reported an incomplete image
+};
+
+enum GrabResult
+{
+	GRAB_OK, // frame returned
+	GRAB_END, // source has no more frames (end of replay)
+	GRAB_FAILED // acquisition error, see Error()
+};
+
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	// Start begins the acquisition. Afterwards the frame geometry and acquisition settings below are valid.
+	virtual bool Start() = 0;
+	// Grab waits for the next frame. The frame must be handed back with Release() before the next Grab().
+	virtual GrabResult Grab(SourceFrame& frame) = 0;
+	virtual void Release() {}
+	virtual void Stop() {}
+	virtual std::string Describe() const = 0;
+	// StreamBufferFill returns the number of filled stream buffers waiting to be grabbed, or -1 if the source has none.
+	virtual long long StreamBufferFill() { return -1; }
+
+	size_t Width() const { return width; }
+	size_t Height() const { return height; }
+	size_t FrameSize() const { return frameSize; }
+	const std::string& PixelFormatName() const { return pixelFormatName; }
+	double ExposureTime() const { return exposureTime; }
+	double Gain() const { return gain; }
+	double FPS() const { return fps; }
+	const std::string& Error() const { return error; }
+
+protected:
+	size_t width = 0;
+	size_t height = 0;
+	size_t frameSize = 0;
+	std::string pixelFormatName;
+	double exposureTime = 0; // microseconds
+	double gain = 0; // dB
+	double fps = 0; // Hz
+	std::string error;
+};
+
+/*
+SyntheticSource generates BayerRG8 frames of width x height at targetFPS (0 = as fast as possible). The frames show a static background
+with a smooth gradient and a few levels of sensor-like noise, a dark object drifts through it during k_objectFrames of every k_period
+frames. Compression, the motion trigger and the detection scripts thus see frames that resemble a river recording.
+*/
+class SyntheticSource : public FrameSource
+{
+public:
+	SyntheticSource(size_t frameWidth, size_t frameHeight, double targetFPS, double exposure, double dGain)
+		: frameCnt(0), objectX(0), objectY(0)
+	{
+		width = frameWidth & ~static_cast<size_t>(1); // whole Bayer quads
+		height = frameHeight & ~static_cast<size_t>(1);
+		frameSize = width * height;
+		pixelFormatName = "BayerRG8";
+		exposureTime = exposure;
+		gain = dGain;
+		fps = targetFPS;
+	}
+
+	bool Start() override
+	{
+		if (frameSize == 0)
+		{
+			error = "synthetic frame size is 0";
+			return false;
+		}
+		background.resize(frameSize);
+		for (size_t y = 0; y < height; y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				uint32_t noise = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u;
+				noise ^= noise >> 13;
+				noise *= 0x5BD1E995u;
+				noise = (noise ^ (noise >> 15)) >> 30; // 0..3
+				background[y * width + x] = static_cast<char>(BayerValue(x, y, 70, 110, 90) + static_cast<int>((x + y) >> 6) + static_cast<int>(noise));
+			}
+		}
+		image = background;
+		frameCnt = 0;
+		start = std::chrono::steady_clock::now();
+		nextFrame = start;
+		return true;
+	}
+
+	GrabResult Grab(SourceFrame& frame) override
+	{
+		if (fps > 0)
+		{
+			nextFrame += std::chrono::nanoseconds(static_cast<long long>(1e9 / fps));
+			std::this_thread::sleep_until(nextFrame);
+		}
+		DrawObject();
+		frame.data = image.data();
+		frame.size = image.size();
+		frame.frameID = frameCnt++;
+		frame.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		return GRAB_OK;
+	}
+
+	std::string Describe() const override
+	{
+		std::stringstream ss;
+		ss << "synthetic " << width << "x" << height << " " << pixelFormatName << " @ ";
+		if (fps > 0) ss << fps << " fps";
+		else ss << "maximum rate";
+		return ss.str();
+	}
+
+private:
+	static const size_t k_objectSize = 64; // pixels
+	static const unsigned long long k_period = 128; // frames
+	static const unsigned long long k_objectFrames = 32; // frames of each period showing the object
+
+	static int BayerValue(size_t x, size_t y, int r, int g, int b) // RGGB mosaic
+	{
+		if ((y & 1) == 0) return (x & 1) == 0 ? r : g;
+		return (x & 1) == 0 ? g : b;
+	}
+
+	// DrawObject restores the background below the previous object position and draws the object at its next position, if it is visible
+	void DrawObject()
+	{
+		if (width < k_objectSize || height < k_objectSize) return;
+		for (size_t y = objectY; y < objectY + k_objectSize; y++)
+		{
+			memcpy(&image[y * width + objectX], &background[y * width + objectX], k_objectSize);
+		}
+		if (frameCnt % k_period >= k_objectFrames) return;
+		objectX = (static_cast<size_t>(frameCnt * 8) % (width - k_objectSize)) & ~static_cast<size_t>(1);
+		objectY = ((height - k_objectSize) / 2 + static_cast<size_t>(frameCnt % 16)) & ~static_cast<size_t>(1);
+		for (size_t y = objectY; y < objectY + k_objectSize; y++)
+		{
+			for (size_t x = objectX; x < objectX + k_objectSize; x++)
+			{
+				image[y * width + x] = static_cast<char>(BayerValue(x, y, 40, 30, 20));
+			}
+		}
+	}
+
+	unsigned long long frameCnt;
+	std::vector<char> background;
+	std::vector<char> image;
+	size_t objectX;
+	size_t objectY;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point nextFrame;
+};
+
+/*
+ReplaySource streams the frames of existing .tmp files in the given order. speed 1 replays at the recorded rate (camera timestamps),
+larger values accelerate the replay and 0 replays as fast as possible. FrameIDs and timestamps are passed on unchanged, so replaying a
+recording reproduces its .tmp files. legacyWidth and legacyHeight are only used for headerless files, which replay at legacyFPS.
+*/
+class ReplaySource : public FrameSource
+{
+public:
+	ReplaySource(const std::vector<std::string>& tmpFiles, double replaySpeed, int legacyWidth, int legacyHeight, double legacyFPS)
+		: files(tmpFiles), speed(replaySpeed), legacyW(legacyWidth), legacyH(legacyHeight), legacyRate(legacyFPS), fileCnt(0), frameCnt(0),
+		replayed(0), firstTimestamp(0)
+	{
+	}
+
+	bool Start() override
+	{
+		fileCnt = 0;
+		frameCnt = 0;
+		replayed = 0;
+		if (!OpenFile(0)) return false;
+		const RodiFileHeader& header = reader.Header();
+		width = header.width;
+		height = header.height;
+		frameSize = header.frameBytes;
+		pixelFormatName = reader.PixelFormatName();
+		exposureTime = header.exposureTime;
+		gain = header.gain;
+		fps = reader.IsLegacy() ? legacyRate : header.fps;
+		start = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	GrabResult Grab(SourceFrame& frame) override
+	{
+		while (frameCnt >= reader.NumFrames())
+		{
+			if (fileCnt + 1 >= files.size()) return GRAB_END;
+			if (!OpenFile(fileCnt + 1)) return GRAB_FAILED;
+		}
+		RodiFrameHeader frameHeader;
+		if (!reader.ReadFrame(frameCnt, buffer, &frameHeader))
+		{
+			error = "could not read frame " + std::to_string(frameCnt) + " of " + files[fileCnt];
+			return GRAB_FAILED;
+		}
+		if (reader.IsLegacy())
+		{
+			frameHeader.frameID = replayed;
+			frameHeader.timestamp = fps > 0 ? static_cast<uint64_t>(replayed * 1e9 / fps) : 0;
+		}
+		if (replayed == 0) firstTimestamp = frameHeader.timestamp;
+		if (speed > 0 && frameHeader.timestamp > firstTimestamp)
+		{
+			const double offset = (frameHeader.timestamp - firstTimestamp) / speed;
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<long long>(offset)));
+		}
+		frame.data = buffer.data();
+		frame.size = buffer.size();
+		frame.frameID = frameHeader.frameID;
+		frame.timestamp = frameHeader.timestamp;
+		frameCnt++;
+		replayed++;
+		return GRAB_OK;
+	}
+
+	void Stop() override { reader.Close(); }
+
+	std::string Describe() const override
+	{
+		std::stringstream ss;
+		ss << "replay of " << files.size() << " file(s), " << width << "x" << height << " " << pixelFormatName << " @ ";
+		if (speed > 0) ss << speed << "x recorded rate";
+		else ss << "maximum rate";
+		return ss.str();
+	}
+
+private:
+	bool OpenFile(size_t i)
+	{
+		if (i >= files.size())
+		{
+			error = "no .tmp files to replay";
+			return false;
+		}
+		if (!reader.Open(files[i], legacyW, legacyH))
+		{
+			error = "could not open " + files[i];
+			return false;
+		}
+		if (i > 0 && (reader.Width() != width || reader.Height() != height || reader.FrameBytes() != frameSize))
+		{
+			error = files[i] + " has a different frame geometry";
+			return false;
+		}
+		fileCnt = i;
+		frameCnt = 0;
+		return true;
+	}
+
+	std::vector<std::string> files;
+	double speed;
+	int legacyW;
+	int legacyH;
+	double legacyRate;
+	RodiRawReader reader;
+	std::vector<char> buffer;
+	size_t fileCnt; // file currently replayed
+	size_t frameCnt; // next frame within that file
+	unsigned long long replayed; // frames replayed so far
+	uint64_t firstTimestamp;
+	std::chrono::steady_clock::time_point start;
+};
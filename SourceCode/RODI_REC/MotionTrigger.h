@@ -0,0 +1,73 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Recording script)
+// MotionTrigger is the change detector of the event-triggered recording mode (triggerMode = 1). It looks at a decimated view of the green
+// CFA plane only (one green sample every decimation Bayer quads in both directions) and compares it with a running-average background.
+// A frame shows activity when at least minPixels samples differ from the background by more than threshold. The background adapts with
+// a rate of 1/16 per frame, so slow changes in light or turbidity do not trigger.
+//========================================================================================================================================
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+
+class MotionTrigger
+{
+public:
+	static const int k_learnShift = 4; // background learning rate 1/2^k_learnShift
+
+	MotionTrigger(size_t frameWidth, size_t frameHeight, const std::string& pixelFormatName, int decimation, int diffThreshold, int minChangedPixels)
+		: width(frameWidth), step(2 * static_cast<size_t>(decimation < 1 ? 1 : decimation)), threshold(diffThreshold), minPixels(minChangedPixels),
+		changed(0), initialized(false)
+	{
+		// green sits next to red/blue in the first row of the quad for RG and BG, in the first pixel for GR, GB and Mono8
+		offset = pixelFormatName == "BayerRG8" || pixelFormatName == "BayerBG8" ? 1 : 0;
+		cols = width > offset ? (width - offset + step - 1) / step : 0;
+		rows = (frameHeight + step - 1) / step;
+		background.resize(cols * rows);
+	}
+
+	// Detect compares frame with the background and updates the background. Returns true if the frame shows activity.
+	bool Detect(const void* frame)
+	{
+		const uint8_t* pixels = static_cast<const uint8_t*>(frame);
+		unsigned int count = 0;
+		for (size_t r = 0; r < rows; r++)
+		{
+			const uint8_t* row = pixels + r * step * width + offset;
+			uint16_t* bg = &background[r * cols];
+			for (size_t c = 0; c < cols; c++)
+			{
+				const int value = row[c * step] << 8; // 8.8 fixed point
+				if (!initialized)
+				{
+					bg[c] = static_cast<uint16_t>(value);
+					continue;
+				}
+				const int diff = value - bg[c];
+				if (abs(diff) > (threshold << 8)) count++;
+				bg[c] = static_cast<uint16_t>(bg[c] + (diff >> k_learnShift));
+			}
+		}
+		initialized = true;
+		changed = count;
+		return count >= static_cast<unsigned int>(minPixels);
+	}
+
+	unsigned int ChangedPixels() const { return changed; } // changed samples of the last frame
+	size_t Samples() const { return background.size(); }
+
+private:
+	size_t width;
+	size_t step; // pixels between samples, a multiple of 2 to stay on the green CFA plane
+	size_t offset; // column of the first green pixel
+	size_t cols;
+	size_t rows;
+	int threshold; // grey levels
+	int minPixels;
+	std::vector<uint16_t> background; // running average, 8.8 fixed point
+	unsigned int changed;
+	bool initialized;
+};
@@ -33,9 +33,26 @@
 #include <assert.h>
 #include <time.h>
 #include <cmath>
+#include <iomanip>
 #include <chrono>
 #include <algorithm>
 #include <string>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+#include "FrameRing.h"
+#include "RawFileWriter.h"
+#include "FrameSource.h"
+#include "AcquisitionStats.h"
+#include "MotionTrigger.h"
+#include "../RODI_Shared/FrameIndex.h"
+#include "../RODI_Shared/RodiRawFormat.h"
+#include <map>
+#include <boost/filesystem.hpp>
 
 //define namespaces
 using namespace std::chrono;
@@ -43,6 +60,7 @@ using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
 using namespace Spinnaker::GenICam;
 using namespace std;
+namespace fs = boost::filesystem;
 
 // Initialize config parameters, will be updated by config file
 std::string outpath;
@@ -53,11 +71,63 @@ double FPS; // frames per second in Hz
 int numBuffers; // depending on RAM
 int numFrames; //needs to be at least 100
 int totalfiles;
+int ringDepth = 100; // frames held in RAM between the grab thread and the writer thread
+int multiCamera = 0; // 1 = record all cameras concurrently, 0 = record cameras one after another
+int simulatedCameras = 0; // number of simulated cameras used instead of the attached cameras (testing without hardware)
+std::string simulatedSource = "synthetic"; // frame source of the simulated cameras: synthetic or replay
+int simWidth = 1920; // resolution of synthetic frames (and of legacy headerless .tmp files replayed)
+int simHeight = 1200;
+std::string replayPath; // folder (or single .tmp file) replayed by simulatedSource=replay
+double replaySpeed = 1; // 1 = replay at the recorded rate, 2 = twice as fast, ..., 0 = as fast as possible
+int directIO = 1; // 1 = write .tmp files with unbuffered direct I/O where the filesystem supports it
+int compression = 0; // 1 = compress frames losslessly (BayerCodec) before they are written, 8-bit pixel formats only
+int compressionThreads = 0; // compression worker threads per camera, 0 = half of the logical processors
+int triggerMode = 0; // 1 = store only frames around activity detected by the motion trigger, 0 = store every frame
+int preRoll = 50; // frames stored before the first frame with activity
+int postRoll = 50; // frames stored after the last frame with activity
+int motionThreshold = 20; // grey levels a green sample has to differ from the background to count as changed
+int motionPixels = 16; // changed samples that make a frame show activity
+int motionDecimation = 4; // the motion trigger looks at one green sample every motionDecimation Bayer quads in both directions
+std::string rotateBy = "frames"; // starts the next .tmp file after numFrames frames (frames), rotateMB megabytes (bytes) or rotateSeconds (seconds)
+double rotateMB = 4000; // size of a .tmp file with rotateBy = bytes
+double rotateSeconds = 60; // duration of a .tmp file with rotateBy = seconds, the recording still lasts totalfiles * numFrames frames
+const int k_rotatedFileNrDigits = 6; // file numbers are padded to this width with rotateBy = bytes or seconds, the number of files is not known in advance
+double statsInterval = 1; // seconds between telemetry reports, 0 = summary at the end of the recording only
+bool benchmarkMode = false; // RODI_REC --benchmark: simulated cameras deliver frames as fast as the pipeline accepts them
 
-// Initialize placeholders
-vector<ofstream> cameraFiles;
-ofstream csvFile;
-string serialNumber;
+// Initialize placeholders, one Segment is a .tmp file with its frame index, one CameraPipeline holds the recording state of one camera
+struct Segment
+{
+	RawFileWriter rawFile;
+	FrameIndexWriter index; // .idx frame index of the .tmp file
+	vector<uint64_t> seekTable; // file offsets of the frames in the .tmp file
+	unsigned int fnr = 0;
+	bool opened = false; // CreateTMP succeeded
+	int64_t firstGrabTime = 0; // steady clock time of the first frame in the file (rotateBy = seconds)
+	unsigned long long records = 0; // frames in the index, stored or discarded
+};
+
+struct CameraPipeline
+{
+	string serialNumber;
+	size_t frameSize = 0; // bytes per frame, used to preallocate the .tmp files
+	RodiFileHeader fileHeader; // written at the start of every .tmp file
+	unique_ptr<Segment> segment; // .tmp file the writer thread is writing
+	unique_ptr<Segment> nextSegment; // .tmp file opened ahead of time by the file thread
+	deque<unique_ptr<Segment>> fullSegments; // .tmp files handed to the file thread to be finalized
+	bool filesDone = false; // no more segments needed
+	mutex segmentMutex; // guards nextSegment, fullSegments and filesDone
+	condition_variable segmentReady;
+	atomic<bool> grabDone; // set by the grab thread once no more frames will be pushed into the ring
+	atomic<bool> writeFailed; // set by the writer thread if a frame could not be written
+	unsigned long long framesRecorded = 0; // frames handed to the writer thread
+	AcquisitionStats stats; // live telemetry, reported by ReportStats
+	bool compress = false; // frames pass through the compression workers
+	unique_ptr<MotionTrigger> trigger; // change detector of triggerMode 1, run by the writer thread
+	double recordSeconds = 0; // from the first grabbed frame until the last frame was written
+	CameraPipeline() : grabDone(false), writeFailed(false) { memset(&fileHeader, 0, sizeof(fileHeader)); }
+};
+mutex consoleMutex; // keeps console lines of concurrently recording cameras apart
 
 /*
 ========================================================================================================================================
@@ -85,6 +155,27 @@ int readconfig(string myconfig)
 			else if (name == "numBuffers") numBuffers = std::stoi(value);
 			else if (name == "numFrames") numFrames = std::stoi(value); 
 			else if (name == "totalfiles") totalfiles = std::stoi(value); 
+			else if (name == "ringDepth") ringDepth = std::stoi(value);
+			else if (name == "multiCamera") multiCamera = std::stoi(value);
+			else if (name == "simulatedCameras") simulatedCameras = std::stoi(value);
+			else if (name == "simulatedSource") simulatedSource = value;
+			else if (name == "simWidth") simWidth = std::stoi(value);
+			else if (name == "simHeight") simHeight = std::stoi(value);
+			else if (name == "replayPath") replayPath = value;
+			else if (name == "replaySpeed") replaySpeed = std::stod(value);
+			else if (name == "directIO") directIO = std::stoi(value);
+			else if (name == "statsInterval") statsInterval = std::stod(value);
+			else if (name == "compression") compression = std::stoi(value);
+			else if (name == "compressionThreads") compressionThreads = std::stoi(value);
+			else if (name == "rotateBy") rotateBy = value;
+			else if (name == "rotateMB") rotateMB = std::stod(value);
+			else if (name == "rotateSeconds") rotateSeconds = std::stod(value);
+			else if (name == "triggerMode") triggerMode = std::stoi(value);
+			else if (name == "preRoll") preRoll = std::stoi(value);
+			else if (name == "postRoll") postRoll = std::stoi(value);
+			else if (name == "motionThreshold") motionThreshold = std::stoi(value);
+			else if (name == "motionPixels") motionPixels = std::stoi(value);
+			else if (name == "motionDecimation") motionDecimation = std::stoi(value);
 		}
 	}
 	else
@@ -99,12 +190,38 @@ int readconfig(string myconfig)
 	cout << "numBuffers=" << numBuffers << endl;
 	cout << "numFrames=" << numFrames << endl;
 	cout << "totalfiles=" << totalfiles << endl;
+	if (ringDepth < 1) ringDepth = 1; // the grab thread needs at least one free slot
+	cout << "ringDepth=" << ringDepth << " frames" << endl;
+	cout << "multiCamera=" << multiCamera << endl;
+	cout << "simulatedCameras=" << simulatedCameras << endl;
+	if (simulatedCameras > 0)
+	{
+		cout << "simulatedSource=" << simulatedSource << endl;
+		cout << "simWidth=" << simWidth << ", simHeight=" << simHeight << endl;
+		if (simulatedSource == "replay") cout << "replayPath=" << replayPath << ", replaySpeed=" << replaySpeed << endl;
+	}
+	cout << "directIO=" << directIO << endl;
+	cout << "statsInterval=" << statsInterval << " s" << endl;
+	cout << "compression=" << compression << ", compressionThreads=" << compressionThreads << endl;
+	if (rotateBy != "bytes" && rotateBy != "seconds") rotateBy = "frames";
+	cout << "rotateBy=" << rotateBy;
+	if (rotateBy == "bytes") cout << ", rotateMB=" << rotateMB << " MB";
+	if (rotateBy == "seconds") cout << ", rotateSeconds=" << rotateSeconds << " s";
+	cout << endl;
+	cout << "triggerMode=" << triggerMode << endl;
+	if (triggerMode == 1)
+	{
+		if (preRoll < 0) preRoll = 0;
+		if (postRoll < 0) postRoll = 0;
+		cout << "preRoll=" << preRoll << " frames, postRoll=" << postRoll << " frames" << endl;
+		cout << "motionThreshold=" << motionThreshold << ", motionPixels=" << motionPixels << ", motionDecimation=" << motionDecimation << endl;
+	}
 	return result,  FPS, exposureTime, dGain, numBuffers, numFrames, totalfiles;
 }
 
 /*
 ========================================================================================================================================
-Helper functions: DateTime, removeSpaces, TimeStamp, CreateTMP and CreateCSV.
+Helper functions: DateTime, removeSpaces, TimeStamp, CreateTMP, CloseTMP and ExportCSV.
 ========================================================================================================================================
 */
 string removeSpaces(string word) // removes spaces in string
@@ -161,7 +278,9 @@ string DateTime() //retrieves date and time in the following format: DDMMYYYY_HH
 string FileNr(int fnr) // generates filenr, adding zero to numbers smaller than a certain threshold
 {
 	stringstream fnrss;
-	if (totalfiles < 10)
+	if (rotateBy != "frames" || totalfiles <= 0) // files rotated by size or duration (index header totalfiles = 0)
+		fnrss << setw(k_rotatedFileNrDigits) << setfill('0') << fnr;
+	else if (totalfiles < 10)
 		fnrss << fnr;
 	else if (totalfiles < 99)
 		if (fnr < 10) fnrss << "0" << fnr;
@@ -192,34 +311,141 @@ auto TimeStamp() // retrieves timestamp of image in nanoseconds
 }
 
 
-int CreateTMP(string serialNumber, int fnr) // creates a .tmp file to store frames in binary format
+void InitFileHeader(CameraPipeline& cam, size_t width, size_t height, string pixelFormatName, double exposure, double gain, double fps) // describes the frames of a camera in its RODI raw file header
+{
+	RodiFileHeader& header = cam.fileHeader;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, k_rodiFileMagic, sizeof(header.magic));
+	header.version = k_rodiVersion;
+	header.headerSize = k_rodiHeaderSize;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.pixelFormat = RodiPixelFormatFromName(pixelFormatName);
+	strncpy(header.pixelFormatName, pixelFormatName.c_str(), sizeof(header.pixelFormatName) - 1);
+	header.bitsPerPixel = width * height > 0 ? static_cast<uint32_t>(cam.frameSize * 8 / (width * height)) : 0;
+	header.frameBytes = static_cast<uint32_t>(cam.frameSize);
+	header.compression = 0;
+	header.exposureTime = exposure;
+	header.gain = gain;
+	header.fps = fps;
+	strncpy(header.serialNumber, cam.serialNumber.c_str(), sizeof(header.serialNumber) - 1);
+}
+
+uint64_t SegmentBytes(const CameraPipeline& cam) // bytes preallocated for a .tmp file, the expected size of an uncompressed file
+{
+	const uint64_t frameBytes = sizeof(RodiFrameHeader) + cam.frameSize + sizeof(uint64_t);
+	double frames = numFrames;
+	if (rotateBy == "bytes") return k_rodiHeaderSize + static_cast<uint64_t>(rotateMB * 1e6) + sizeof(RodiSeekFooter);
+	if (rotateBy == "seconds") frames = rotateSeconds * (cam.fileHeader.fps > 0 ? cam.fileHeader.fps : FPS);
+	return k_rodiHeaderSize + static_cast<uint64_t>(frames > 0 ? frames : 0) * frameBytes + sizeof(RodiSeekFooter);
+}
+
+int CreateTMP(CameraPipeline& cam, Segment& segment, unsigned int fnr) // creates a preallocated .tmp file to store frames in the RODI raw format
 {
 	int result = 0;
 	stringstream sstream_tmpFilename;
 	string tmpFilename;
-	ofstream filename; // TODO: still needed?
 	// Create temporary file from serialnr and filenumber
-	sstream_tmpFilename << outpath << "/" << serialNumber << "_file" << FileNr(fnr) << ".tmp";
+	sstream_tmpFilename << outpath << "/" << cam.serialNumber << "_file" << FileNr(fnr) << ".tmp";
 	sstream_tmpFilename >> tmpFilename;
 	//cout << "File " << tmpFilename << " initialized" << endl;
-	cameraFiles.push_back(std::move(filename)); // TODO: still needed?
-	cameraFiles[fnr].open(tmpFilename.c_str(), ios_base::out | ios_base::binary);
+	segment.fnr = fnr;
+	if (!segment.rawFile.Open(tmpFilename, SegmentBytes(cam), directIO == 1))
+	{
+		result = -1;
+	}
+	// Write the file header, padded to k_rodiHeaderSize, and flush it so a watcher never sees the preallocated zeros as a headerless file
+	vector<char> headerBlock(k_rodiHeaderSize, 0);
+	RodiFileHeader header = cam.fileHeader;
+	header.fileNumber = fnr;
+	header.createdTime = static_cast<int64_t>(time(0));
+	memcpy(headerBlock.data(), &header, sizeof(header));
+	if (result == 0 && (!segment.rawFile.Write(headerBlock.data(), headerBlock.size()) || !segment.rawFile.Flush()))
+	{
+		result = -1;
+	}
+	segment.seekTable.clear();
+	// Create the binary frame index next to it
+	string idxFilename = tmpFilename.substr(0, tmpFilename.length() - 4) + ".idx";
+	if (!segment.index.Open(idxFilename, cam.serialNumber, fnr, rotateBy == "frames" ? totalfiles : 0))
+	{
+		result = -1;
+	}
+	segment.opened = result == 0;
+	return result;
+}
+
+int CloseTMP(Segment& segment) // appends the seek table, closes a .tmp file and its frame index, and reports its write performance
+{
+	int result = 0;
+	RodiSeekFooter footer;
+	memcpy(footer.magic, k_rodiSeekMagic, sizeof(footer.magic));
+	footer.numFrames = segment.seekTable.size();
+	footer.tableOffset = segment.rawFile.BytesWritten();
+	if (!segment.rawFile.Write(segment.seekTable.data(), segment.seekTable.size() * sizeof(uint64_t)) || !segment.rawFile.Write(&footer, sizeof(footer)))
+	{
+		result = -1;
+	}
+	if (!segment.rawFile.Close()) result = -1;
+	if (!segment.index.Close()) result = -1;
+	lock_guard<mutex> lock(consoleMutex);
+	cout << "	   " << segment.rawFile.Path() << ": " << segment.seekTable.size() << " frames, " << segment.rawFile.BytesWritten() / 1000000 << " MB, "
+		<< segment.rawFile.SustainedMBps() << " MB/s sustained, " << segment.rawFile.WorstWriteMs() << " ms worst write"
+		<< (segment.rawFile.DirectIO() ? " (direct I/O)" : " (buffered I/O)") << endl;
 	return result;
 }
 
-int CreateCSV(string SerialNumber) // creates a .csv log file that keeps track of all frames
+int ExportCSV(string folder, bool withStored) // regenerates the .csv log file of every camera from the .idx frame indexes in folder, withStored adds the Stored column (motion trigger)
 {
 	int result = 0;
-	stringstream sstream_csvFile;
-	string csvFilename;
-	// Create .csv logfile
-	sstream_csvFile << outpath << "/" << serialNumber << "logfile_" << DateTime() << ".csv";
-	sstream_csvFile >> csvFilename;
-	csvFile.open(csvFilename);
-	csvFile << "FrameID" << "," << "Timestamp" << "," << "SerialNumber" << "," << "FileNumber" << "," << "SystemTimeInNanoseconds" << endl;
+	// collect the frame indexes per camera, ordered by file number
+	map<string, map<uint32_t, string>> indexFiles;
+	for (auto i = fs::directory_iterator(fs::path(folder)); i != fs::directory_iterator(); i++)
+	{
+		if (is_directory(i->path()) || i->path().extension() != ".idx") continue;
+		FrameIndexHeader header;
+		vector<FrameIndexRecord> records;
+		if (!ReadFrameIndex(i->path().string(), header, records)) continue;
+		indexFiles[header.serialNumber][header.fileNumber] = i->path().string();
+	}
+	for (auto& camera : indexFiles)
+	{
+		string csvFilename = folder + "/" + camera.first + "logfile_" + DateTime() + ".csv";
+		ofstream csvFile(csvFilename);
+		csvFile << "FrameID" << "," << "Timestamp" << "," << "SerialNumber" << "," << "FileNumber" << "," << "SystemTimeInNanoseconds";
+		if (withStored) csvFile << "," << "Stored";
+		csvFile << "\n";
+		unsigned long long numRecords = 0;
+		for (auto& file : camera.second)
+		{
+			FrameIndexHeader header;
+			vector<FrameIndexRecord> records;
+			ReadFrameIndex(file.second, header, records);
+			totalfiles = header.totalfiles; // FileNr() pads file numbers based on totalfiles, to a fixed width if it is 0 (rotated files)
+			for (size_t r = 0; r < records.size(); r++)
+			{
+				csvFile << records[r].frameID << "," << records[r].timestamp << "," << camera.first << "," << FileNr(records[r].fileNumber) << "," << records[r].hostTimestamp;
+				if (withStored) csvFile << "," << ((records[r].flags & k_rodiFrameDiscarded) ? 0 : 1);
+				csvFile << "\n";
+			}
+			numRecords += records.size();
+		}
+		csvFile.close();
+		if (!csvFile) result = -1;
+		cout << "	+" << csvFilename << ": " << numRecords << " frames from " << camera.second.size() << " index files" << endl;
+	}
 	return result;
 }
 
+// CameraFailure reports a failure of a camera pipeline and returns -1. Cameras may run in parallel threads, so it only prints the message
+// (under consoleMutex) and main asks once for enter after all cameras have finished.
+int CameraFailure(const string& message)
+{
+	lock_guard<mutex> lock(consoleMutex);
+	cout << "Failure: " << message << endl;
+	return -1;
+}
+
 /*
 ========================================================================================================================================
 ConfigureFramerate sets the desired Framerate for the camera.
@@ -240,19 +466,13 @@ int ConfigureFramerate(CameraPtr pCam)
 			CEnumerationPtr ptrFrameRateAuto = pCam->GetNodeMap().GetNode("AcquisitionFrameRateAuto");
 			if (!IsAvailable(ptrFrameRateAuto) || !IsWritable(ptrFrameRateAuto))
 			{
-				cout << "Failure: Unable to set FrameRateAuto." << endl;
-				cout << "Press enter to exit." << endl << endl;
-				getchar();
-				return -1;
+				return CameraFailure("Unable to set FrameRateAuto.");
 			}
 			// Retrieve entry node from enumeration node
 			CEnumEntryPtr ptrFrameRateAutoOff = ptrFrameRateAuto->GetEntryByName("Off");
 			if (!IsAvailable(ptrFrameRateAutoOff) || !IsReadable(ptrFrameRateAutoOff))
 			{
-				cout << "Failure: Unable to set Frame Rate to Off." << endl;
-				cout << "Press enter to exit." << endl << endl;
-				getchar();
-				return -1;
+				return CameraFailure("Unable to set Frame Rate to Off.");
 			}
 			int64_t framerateAutoOff = ptrFrameRateAutoOff->GetValue();
 
@@ -261,10 +481,7 @@ int ConfigureFramerate(CameraPtr pCam)
 			CBooleanPtr ptrAcquisitionFrameRateControlEnabled = pCam->GetNodeMap().GetNode("AcquisitionFrameRateEnabled");
 			if (!IsAvailable(ptrAcquisitionFrameRateControlEnabled) || !IsWritable(ptrAcquisitionFrameRateControlEnabled))
 			{
-				cout << "Failure: Unable to set AcquisitionFrameRateControlEnabled." << endl;
-				cout << "Press enter to exit." << endl << endl;
-				getchar();
-				return -1;
+				return CameraFailure("Unable to set AcquisitionFrameRateControlEnabled.");
 			}
 			ptrAcquisitionFrameRateControlEnabled->SetValue(true);
 		}
@@ -277,10 +494,7 @@ int ConfigureFramerate(CameraPtr pCam)
 		CFloatPtr ptrAcquisitionFrameRate = pCam->GetNodeMap().GetNode("AcquisitionFrameRate");
 		if (!IsAvailable(ptrAcquisitionFrameRate) || !IsReadable(ptrAcquisitionFrameRate))
 		{
-			cout << "Failure: Unable to get node AcquisitionFrameRate." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to get node AcquisitionFrameRate.");
 		}
 		ptrAcquisitionFrameRate->SetValue(ptrAcquisitionFrameRate->GetMax());
 
@@ -308,10 +522,7 @@ int ConfigureFramerate(CameraPtr pCam)
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure(e.what());
 	}
 	return result;
 }
@@ -330,45 +541,30 @@ int BufferHandlingSettings(CameraPtr pCam)
 	CEnumerationPtr ptrHandlingMode = sNodeMap.GetNode("StreamBufferHandlingMode");
 	if (!IsAvailable(ptrHandlingMode) || !IsWritable(ptrHandlingMode))
 	{
-		cout << "Failure: Unable to set Buffer Handling mode (node retrieval)." << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure("Unable to set Buffer Handling mode (node retrieval).");
 	}
 	CEnumEntryPtr ptrHandlingModeEntry = ptrHandlingMode->GetCurrentEntry();
 	if (!IsAvailable(ptrHandlingModeEntry) || !IsReadable(ptrHandlingModeEntry))
 	{
-		cout << "Failure: Unable to set Buffer Handling mode (Entry retrieval)." << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure("Unable to set Buffer Handling mode (Entry retrieval).");
 	}
 	// Set stream buffer Count Mode to manual
 	CEnumerationPtr ptrStreamBufferCountMode = sNodeMap.GetNode("StreamBufferCountMode");
 	if (!IsAvailable(ptrStreamBufferCountMode) || !IsWritable(ptrStreamBufferCountMode))
 	{
-		cout << "Failure: Unable to set Buffer Count Mode (node retrieval)." << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure("Unable to set Buffer Count Mode (node retrieval).");
 	}
 		CEnumEntryPtr ptrStreamBufferCountModeManual = ptrStreamBufferCountMode->GetEntryByName("Manual");
 	if (!IsAvailable(ptrStreamBufferCountModeManual) || !IsReadable(ptrStreamBufferCountModeManual))
 	{
-		cout << "Failure: Unable to set Buffer Count Mode entry (Entry retrieval)." << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure("Unable to set Buffer Count Mode entry (Entry retrieval).");
 	}
 	ptrStreamBufferCountMode->SetIntValue(ptrStreamBufferCountModeManual->GetValue());
 	// Retrieve and modify Stream Buffer Count
 	CIntegerPtr ptrBufferCount = sNodeMap.GetNode("StreamBufferCountManual");
 	if (!IsAvailable(ptrBufferCount) || !IsWritable(ptrBufferCount))
 	{
-		cout << "Failure: Unable to set Buffer Count (Integer node retrieval)." << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure("Unable to set Buffer Count (Integer node retrieval).");
 	}
 
 	// Display Buffer Info
@@ -399,18 +595,12 @@ int ConfigureExposure(CameraPtr pCam)
 		CEnumerationPtr ptrExposureAuto = pCam->GetNodeMap().GetNode("ExposureAuto");
 		if (!IsAvailable(ptrExposureAuto) || !IsWritable(ptrExposureAuto))
 		{
-			cout << "Failure: Unable to disable automatic exposure." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to disable automatic exposure.");
 		}
 		CEnumEntryPtr ptrExposureAutoOff = ptrExposureAuto->GetEntryByName("Off");
 		if (!IsAvailable(ptrExposureAutoOff) || !IsReadable(ptrExposureAutoOff))
 		{
-			cout << "Failure: Unable to disable automatic exposure." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to disable automatic exposure.");
 		}
 		ptrExposureAuto->SetIntValue(ptrExposureAutoOff->GetValue());
 
@@ -418,10 +608,7 @@ int ConfigureExposure(CameraPtr pCam)
 		CFloatPtr ptrExposureTime = pCam->GetNodeMap().GetNode("ExposureTime");
 		if (!IsAvailable(ptrExposureTime) || !IsWritable(ptrExposureTime))
 		{
-			cout << "Failure: Unable to set exposure time." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to set exposure time.");
 		}
 		// Desired exposure from config
 		double exposureTimeToSet = exposureTime; // Exposure time will limit FPS by 1000000/exposure
@@ -444,10 +631,7 @@ int ConfigureExposure(CameraPtr pCam)
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure(e.what());
 	}
 	return result;
 }
@@ -466,28 +650,19 @@ int ConfigureGain(CameraPtr pCam)
 		CEnumerationPtr ptrGainAuto = pCam->GetNodeMap().GetNode("GainAuto");
 		if (!IsAvailable(ptrGainAuto) || !IsWritable(ptrGainAuto))
 		{
-			cout << "Failure: Unable to disable automatic exposure." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to disable automatic exposure.");
 		}
 		CEnumEntryPtr ptrGainAutoOff = ptrGainAuto->GetEntryByName("Off");
 		if (!IsAvailable(ptrGainAutoOff) || !IsReadable(ptrGainAutoOff))
 		{
-			cout << "Failure: Unable to disable automatic gain." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to disable automatic gain.");
 		}
 		ptrGainAuto->SetIntValue(ptrGainAutoOff->GetValue());
 		// Set exposure time manually; exposure time recorded in microseconds
 		CFloatPtr ptrGain = pCam->GetNodeMap().GetNode("Gain");
 		if (!IsAvailable(ptrGain) || !IsWritable(ptrGain))
 		{
-			cout << "Failure: Unable to set Gain." << endl;
-			cout << "Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to set Gain.");
 		}
 		// Desired exposure from config
 		double GainToSet = dGain;
@@ -495,10 +670,7 @@ int ConfigureGain(CameraPtr pCam)
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure(e.what());
 	}
 	return result;
 }
@@ -525,94 +697,549 @@ int CleanBuffer(CameraPtr pCam)
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure(e.what());
 	}
 	pCam->EndAcquisition();
 	return result;
 }
 /*
 ========================================================================================================================================
-AcquireImages will retrieve images from the camera and write them into the temporary file.
+RotateFiles runs on the file thread of a camera. It keeps the next .tmp file opened and preallocated before the writer thread needs it,
+and finalizes full .tmp files (seek table, footer, close) in the background, so file rotation never stalls the writer thread. .tmp files
+that only received discarded frames (triggerMode 1) are removed, their .idx keeps the timestamps. It returns once the writer is done.
 ========================================================================================================================================
 */
-int AcquireImages(CameraPtr pCam, INodeMap& nodeMap, INodeMap& nodeMapTLDevice)
+void RotateFiles(CameraPipeline* cam)
 {
-	int result = 0;
-	cout << endl << "--- Acquiring images ---" << endl << endl;
-	try
+	unsigned int fnr = 0;
+	unique_lock<mutex> lock(cam->segmentMutex);
+	while (true)
 	{
-		// Create the .csv log file
-		CreateCSV(serialNumber); 
-		// Begin acquiring images
-		pCam->BeginAcquisition();
-		// first image is discarded
-		ImagePtr pResultImage = pCam->GetNextImage();
-		char* imageData = static_cast<char*>(pResultImage->GetData());
-		pResultImage->Release();
-		int stopwait = 0;
-		for (unsigned int fnr = 0; fnr < totalfiles; fnr++)
+		if (!cam->fullSegments.empty())
+		{
+			unique_ptr<Segment> full = move(cam->fullSegments.front());
+			cam->fullSegments.pop_front();
+			lock.unlock();
+			const bool empty = full->seekTable.empty();
+			if (full->opened && CloseTMP(*full) != 0) cam->writeFailed = true;
+			boost::system::error_code ec;
+			if (empty) fs::remove(fs::path(full->rawFile.Path()), ec);
+			lock.lock();
+			continue;
+		}
+		if (cam->filesDone) break;
+		if (!cam->nextSegment)
 		{
-			CreateTMP(serialNumber, fnr);
-			cout << "	++ saving " << numFrames << " frames to file " << fnr << "/" << totalfiles << " ++" << endl;
-			const unsigned int k_numFrames = numFrames;
-			for (unsigned int FrameCnt = 0; FrameCnt < k_numFrames; FrameCnt++)
+			lock.unlock();
+			unique_ptr<Segment> next(new Segment);
+			CreateTMP(*cam, *next, fnr++);
+			lock.lock();
+			cam->nextSegment = move(next);
+			cam->segmentReady.notify_all();
+			continue;
+		}
+		cam->segmentReady.wait(lock);
+	}
+	// remove the file opened ahead of time for a rotation that never came
+	unique_ptr<Segment> unused = move(cam->nextSegment);
+	lock.unlock();
+	if (unused && unused->opened)
+	{
+		unused->rawFile.Close();
+		unused->index.Close();
+		boost::system::error_code ec;
+		fs::remove(fs::path(unused->rawFile.Path()), ec);
+		const string idxFilename = unused->rawFile.Path().substr(0, unused->rawFile.Path().length() - 4) + ".idx";
+		fs::remove(fs::path(idxFilename), ec);
+	}
+}
+
+// TakeNextSegment makes the file opened ahead by the file thread the current file of the writer thread, waiting for it if necessary
+bool TakeNextSegment(CameraPipeline& cam)
+{
+	unique_lock<mutex> lock(cam.segmentMutex);
+	cam.segmentReady.wait(lock, [&cam] { return cam.nextSegment != nullptr; });
+	cam.segment = move(cam.nextSegment);
+	cam.segmentReady.notify_all(); // let the file thread open the one after
+	lock.unlock();
+	if (!cam.segment->opened) return false;
+	cam.segment->rawFile.RestartClock();
+	lock_guard<mutex> consoleLock(consoleMutex);
+	cout << "	++ " << cam.serialNumber << ": saving ";
+	if (rotateBy == "bytes") cout << rotateMB << " MB to file " << cam.segment->fnr << " ++" << endl;
+	else if (rotateBy == "seconds") cout << rotateSeconds << " s to file " << cam.segment->fnr << " ++" << endl;
+	else cout << numFrames << " frames to file " << cam.segment->fnr << "/" << totalfiles << " ++" << endl;
+	return true;
+}
+
+// RetireSegment hands the current file of the writer thread to the file thread to be finalized
+void RetireSegment(CameraPipeline& cam)
+{
+	lock_guard<mutex> lock(cam.segmentMutex);
+	cam.fullSegments.push_back(move(cam.segment));
+	cam.segmentReady.notify_all();
+}
+
+// RotationDue tells whether the next frame (payloadSize bytes, 0 if it is discarded, grabbed at grabTime) belongs into a new file according to rotateBy
+bool RotationDue(const Segment& segment, size_t payloadSize, int64_t grabTime)
+{
+	if (rotateBy == "seconds") return segment.records > 0 && grabTime - segment.firstGrabTime >= static_cast<int64_t>(rotateSeconds * 1e9);
+	if (payloadSize == 0) return false; // discarded frames stay with the file of the frames stored before them
+	if (rotateBy == "bytes")
+	{
+		const uint64_t size = segment.rawFile.BytesWritten() + sizeof(RodiFrameHeader) + payloadSize + (segment.seekTable.size() + 1) * sizeof(uint64_t) + sizeof(RodiSeekFooter);
+		return !segment.seekTable.empty() && size > rotateMB * 1e6;
+	}
+	return segment.seekTable.size() >= static_cast<size_t>(numFrames);
+}
+
+/*
+========================================================================================================================================
+WriteFrames runs on the writer thread of a camera. It drains the frame ring into the .tmp files and their frame indexes, so that disk stalls
+never hold up the grab thread. The .tmp files come ready-opened from the file thread (RotateFiles) and go back to it once rotateBy says
+the next frame belongs into a new file. It returns once the grab thread has finished and the ring is drained, or a write failed.
+With triggerMode 1 the writer runs the motion trigger on the frames ahead of it in the ring and stores a frame only if activity was
+detected within preRoll frames after it or postRoll frames before it. Every frame, stored or discarded, gets its frame index record.
+========================================================================================================================================
+*/
+void WriteFrames(CameraPipeline* cam, FrameRing* ring)
+{
+	unsigned long long seq = 0; // grab sequence number of the oldest frame in the ring
+	unsigned long long inspected = 0; // frames the motion trigger has looked at
+	deque<unsigned long long> motionFrames; // sequence numbers of frames with activity that may still open or extend a stored window
+	while (true)
+	{
+		if (cam->trigger)
+		{
+			FrameSlot* ahead;
+			while ((ahead = ring->Peek(static_cast<size_t>(inspected - seq))) != nullptr)
 			{
-				try
+				if (cam->trigger->Detect(ahead->data.data()))
 				{
-					// Retrieve image and ensure image completion
-					try
-					{
-						pResultImage = pCam->GetNextImage(1000); // timeout for NextImage in miliseconds
-					}
-					catch (Spinnaker::Exception& e)
-					{
-						cout << "Failure: " << e.what() << endl;
-						cout << "Press enter to exit." << endl << endl;
-						getchar();
-						return -1;
-					}
-					// Retrieve imageData
-					imageData = static_cast<char*>(pResultImage->GetData());
-					// write frame to respective cameraFile
-					cameraFiles[fnr].write(imageData, pResultImage->GetImageSize());
-					csvFile << pResultImage->GetFrameID() << "," << pResultImage->GetTimeStamp() << "," << serialNumber << "," << FileNr(fnr) << endl;
-					// Check if the writing is successful
-					if (!cameraFiles[fnr].good())
-					{
-						cout << "Error writing to file for camera!" << endl;
-						cout << "Press enter to exit." << endl << endl;
-						getchar();
-						return -1;
-					}
-					pResultImage->Release();
-				}
-				catch (Spinnaker::Exception& e)
-				{
-					cout << "Failure: " << e.what() << endl;
-					cout << "Press enter to exit." << endl << endl;
-					getchar();
-					return -1;
+					motionFrames.push_back(inspected);
+					cam->stats.MotionDetected();
 				}
+				inspected++;
 			}
-			cameraFiles[fnr].close();
+		}
+		FrameSlot* slot = ring->BeginRead();
+		if (slot == nullptr)
+		{
+			if (cam->grabDone && ring->Occupancy() == 0) break; // ring drained and no more frames coming
+			this_thread::sleep_for(milliseconds(1));
+			continue;
+		}
+		bool store = true;
+		uint32_t flags = slot->flags;
+		if (cam->trigger)
+		{
+			// decide once the pre-roll window of this frame has been inspected, or no more frames will come
+			if (inspected <= seq + preRoll && !(cam->grabDone && inspected == seq + ring->Occupancy()))
+			{
+				this_thread::sleep_for(milliseconds(1));
+				continue;
+			}
+			while (!motionFrames.empty() && motionFrames.front() + postRoll < seq) motionFrames.pop_front();
+			store = !motionFrames.empty() && motionFrames.front() <= seq + preRoll;
+			if (binary_search(motionFrames.begin(), motionFrames.end(), seq)) flags |= k_rodiFrameMotion;
+		}
+		const bool packed = cam->compress && (flags & k_rodiFrameRaw) == 0;
+		const size_t payloadSize = packed ? slot->packed.size() : slot->size;
+		if (cam->segment && RotationDue(*cam->segment, store ? payloadSize : 0, slot->grabTime)) RetireSegment(*cam);
+		if (!cam->segment && !TakeNextSegment(*cam))
+		{
+			lock_guard<mutex> lock(consoleMutex);
+			cout << "Failure: could not create the next file for camera " << cam->serialNumber << "!" << endl;
+			cam->writeFailed = true;
+			break;
+		}
+		Segment& segment = *cam->segment;
+		if (segment.records++ == 0) segment.firstGrabTime = slot->grabTime;
+		bool written;
+		if (store)
+		{
+			// write frame header and frame (compressed if the workers managed to) to respective cameraFile
+			const steady_clock::time_point writeStart = steady_clock::now();
+			const uint64_t offset = segment.rawFile.BytesWritten();
+			const void* payload = packed ? static_cast<const void*>(slot->packed.data()) : static_cast<const void*>(slot->data.data());
+			RodiFrameHeader frameHeader = { k_rodiFrameMagic, static_cast<uint32_t>(payloadSize), slot->frameID, slot->timestamp, flags, 0 };
+			FrameIndexRecord record = { slot->frameID, slot->timestamp, slot->hostTimestamp, segment.fnr, flags, offset };
+			segment.seekTable.push_back(offset);
+			written = segment.rawFile.Write(&frameHeader, sizeof(frameHeader)) && segment.rawFile.Write(payload, payloadSize) && segment.index.Append(record);
+			ring->EndRead();
+			cam->stats.FrameWritten(duration_cast<nanoseconds>(steady_clock::now() - writeStart).count());
+		}
+		else
+		{
+			// keep the timestamp of the discarded frame in the index
+			FrameIndexRecord record = { slot->frameID, slot->timestamp, slot->hostTimestamp, segment.fnr, flags | k_rodiFrameDiscarded, 0 };
+			written = segment.index.Append(record);
+			ring->EndRead();
+			cam->stats.FrameDiscarded();
+		}
+		seq++;
+		// Check if the writing is successful
+		if (!written)
+		{
+			lock_guard<mutex> lock(consoleMutex);
+			cout << "Error writing to file for camera " << cam->serialNumber << "!" << endl;
+			cam->writeFailed = true;
+			break;
+		}
+	}
+	if (cam->segment) RetireSegment(*cam);
+	lock_guard<mutex> lock(cam->segmentMutex);
+	cam->filesDone = true;
+	cam->segmentReady.notify_all();
+}
 
+/*
+========================================================================================================================================
+CompressFrames runs on the compression workers of a camera. Each worker claims the next grabbed frame from the ring and compresses it
+losslessly with BayerCodec; frames that do not get smaller are flagged k_rodiFrameRaw and written as they are. It returns once the grab
+thread has finished and every frame has been claimed.
+========================================================================================================================================
+*/
+void CompressFrames(CameraPipeline* cam, FrameRing* ring)
+{
+	const size_t width = cam->fileHeader.width;
+	const size_t height = cam->fileHeader.height;
+	while (true)
+	{
+		const bool grabDone = cam->grabDone; // read before claiming: the frames committed before grabDone was set are claimable below
+		FrameSlot* slot = ring->BeginProcess();
+		if (slot == nullptr)
+		{
+			if (grabDone) break; // grab thread finished, no frame left to claim
+			this_thread::sleep_for(milliseconds(1));
+			continue;
+		}
+		const steady_clock::time_point start = steady_clock::now();
+		const bool packed = slot->size == width * height && BayerCodec::Encode(reinterpret_cast<const uint8_t*>(slot->data.data()), width, height, slot->packed);
+		if (!packed) slot->flags |= k_rodiFrameRaw;
+		cam->stats.FrameCompressed(slot->size, packed ? slot->packed.size() : slot->size, duration_cast<nanoseconds>(steady_clock::now() - start).count());
+		ring->EndProcess(slot);
 	}
-	pCam->EndAcquisition(); //Ending acquisition appropriately helps ensure that devices clean up properly and do not need to be power-cycled to maintain integrity.
-	csvFile.close();
+}
+
+/*
+========================================================================================================================================
+PushFrame copies one frame into the frame ring of a camera. If the ring is full it waits for the writer thread, the camera stream
+buffers hold new frames in the meantime. Returns false if the writer thread has failed and no more frames should be grabbed.
+========================================================================================================================================
+*/
+bool PushFrame(CameraPipeline& cam, FrameRing& ring, const void* imageData, size_t imageSize, uint64_t frameID, uint64_t timestamp, uint32_t flags)
+{
+	FrameSlot* slot = ring.BeginWrite();
+	while (slot == nullptr && !cam.writeFailed)
+	{
+		this_thread::yield();
+		slot = ring.BeginWrite();
 	}
-	catch (Spinnaker::Exception& e)
+	if (slot == nullptr) return false;
+	if (imageSize > slot->data.size()) slot->data.resize(imageSize);
+	memcpy(slot->data.data(), imageData, imageSize);
+	slot->size = imageSize;
+	slot->frameID = frameID;
+	slot->timestamp = timestamp;
+	slot->hostTimestamp = TimeStamp();
+	slot->grabTime = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	slot->flags = flags;
+	ring.CommitWrite();
+	return true;
+}
+
+/*
+========================================================================================================================================
+SpinnakerSource delivers the frames of an attached FLIR camera to AcquireImages. The camera has to be configured by InitializeCamera
+before Start() is called.
+========================================================================================================================================
+*/
+class SpinnakerSource : public FrameSource
+{
+public:
+	SpinnakerSource(CameraPtr camera, INodeMap& cameraNodeMap) : pCam(camera), nodeMap(cameraNodeMap) {}
+
+	bool Start() override
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
+		try
+		{
+			// Begin acquiring images
+			pCam->BeginAcquisition();
+			// first image is discarded, its size is used to preallocate the frame ring and to describe the frames in the file header
+			ImagePtr pFirstImage = pCam->GetNextImage();
+			frameSize = pFirstImage->GetImageSize();
+			width = pFirstImage->GetWidth();
+			height = pFirstImage->GetHeight();
+			pixelFormatName = string(pFirstImage->GetPixelFormatName().c_str());
+			pFirstImage->Release();
+			exposureTime = ::exposureTime;
+			gain = dGain;
+			fps = ::FPS;
+			CFloatPtr ptrExposureTime = nodeMap.GetNode("ExposureTime");
+			if (IsAvailable(ptrExposureTime) && IsReadable(ptrExposureTime)) exposureTime = ptrExposureTime->GetValue();
+			CFloatPtr ptrGain = nodeMap.GetNode("Gain");
+			if (IsAvailable(ptrGain) && IsReadable(ptrGain)) gain = ptrGain->GetValue();
+			CFloatPtr ptrResultingFrameRate = nodeMap.GetNode("AcquisitionResultingFrameRate");
+			if (IsAvailable(ptrResultingFrameRate) && IsReadable(ptrResultingFrameRate)) fps = ptrResultingFrameRate->GetValue();
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			error = e.what();
+			return false;
+		}
+		return true;
+	}
+
+	GrabResult Grab(SourceFrame& frame) override
+	{
+		try
+		{
+			// Retrieve image
+			pResultImage = pCam->GetNextImage(1000); // timeout for NextImage in miliseconds
+			frame.data = pResultImage->GetData();
+			frame.size = pResultImage->GetImageSize();
+			frame.frameID = pResultImage->GetFrameID();
+			frame.timestamp = pResultImage->GetTimeStamp();
+			frame.incomplete = pResultImage->IsIncomplete();
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			error = e.what();
+			return GRAB_FAILED;
+		}
+		return GRAB_OK;
+	}
+
+	void Release() override
+	{
+		// hand the buffer back to the camera
+		pResultImage->Release();
+	}
+
+	void Stop() override
+	{
+		try
+		{
+			pCam->EndAcquisition(); //Ending acquisition appropriately helps ensure that devices clean up properly and do not need to be power-cycled to maintain integrity.
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			error = e.what();
+		}
+	}
+
+	long long StreamBufferFill() override
+	{
+		try
+		{
+			CIntegerPtr ptrOutputBufferCount = pCam->GetTLStreamNodeMap().GetNode("StreamOutputBufferCount");
+			if (IsAvailable(ptrOutputBufferCount) && IsReadable(ptrOutputBufferCount)) return ptrOutputBufferCount->GetValue();
+		}
+		catch (Spinnaker::Exception&)
+		{
+		}
 		return -1;
 	}
-	return result;
+
+	string Describe() const override
+	{
+		stringstream ss;
+		ss << "camera " << width << "x" << height << " " << pixelFormatName << " @ " << fps << " fps";
+		return ss.str();
+	}
+
+private:
+	CameraPtr pCam;
+	INodeMap& nodeMap;
+	ImagePtr pResultImage;
+};
+
+/*
+========================================================================================================================================
+ReportStats runs on the telemetry thread of a camera. Every statsInterval seconds it prints the acquisition telemetry and appends it to
+<serial>stats_<DateTime>.csv in outpath, until done is set. The last row covers the whole recording.
+========================================================================================================================================
+*/
+void ReportStats(CameraPipeline* cam, FrameRing* ring, atomic<bool>* done)
+{
+	string statsFilename = outpath + "/" + cam->serialNumber + "stats_" + DateTime() + ".csv";
+	ofstream statsFile(statsFilename);
+	statsFile << "ElapsedSeconds,Grabbed,Dropped,Incomplete,Written,Discarded,AchievedFPS,ConfiguredFPS,RingFill,RingHighWaterMark,StreamBufferFill,WorstWriteMs";
+	for (int i = 0; i < AcquisitionStats::k_latencyBuckets - 1; i++)
+	{
+		statsFile << ",WriteBelow" << AcquisitionStats::LatencyLimitMs(i) << "ms";
+	}
+	statsFile << ",WriteAbove" << AcquisitionStats::LatencyLimitMs(AcquisitionStats::k_latencyBuckets - 2) << "ms" << ",CompressionRatio,CompressMsPerFrame" << "\n";
+	const AcquisitionStats& stats = cam->stats;
+	const steady_clock::time_point start = steady_clock::now();
+	steady_clock::time_point last = start;
+	unsigned long long lastGrabbed = 0;
+	bool finished = false;
+	while (!finished)
+	{
+		// wait for the next report, or the end of the recording
+		const steady_clock::time_point next = last + microseconds(static_cast<long long>(statsInterval * 1e6));
+		while (!*done && (statsInterval <= 0 || steady_clock::now() < next))
+		{
+			this_thread::sleep_for(milliseconds(50));
+		}
+		finished = *done;
+		const steady_clock::time_point now = steady_clock::now();
+		const unsigned long long grabbed = stats.Grabbed();
+		// the last row reports the average frame rate of the whole recording
+		const double seconds = duration<double>(now - (finished ? start : last)).count();
+		const double achievedFPS = seconds > 0 ? (grabbed - (finished ? 0 : lastGrabbed)) / seconds : 0;
+		statsFile << duration<double>(now - start).count() << "," << grabbed << "," << stats.Dropped() << "," << stats.Incomplete() << "," << stats.Written() << "," << stats.Discarded() << ","
+			<< achievedFPS << "," << FPS << "," << ring->Occupancy() << "," << ring->HighWaterMark() << "," << stats.BufferFill() << "," << stats.WorstWriteMs();
+		for (int i = 0; i < AcquisitionStats::k_latencyBuckets; i++)
+		{
+			statsFile << "," << stats.LatencyCount(i);
+		}
+		statsFile << "," << stats.CompressionRatio() << "," << stats.CompressMsPerFrame() << "\n";
+		statsFile.flush();
+		if (statsInterval > 0 && !finished)
+		{
+			lock_guard<mutex> lock(consoleMutex);
+			cout << "	" << cam->serialNumber << " | " << achievedFPS << " fps (" << FPS << " configured) | grabbed " << grabbed << ", dropped " << stats.Dropped()
+				<< ", incomplete " << stats.Incomplete() << ", written " << stats.Written() << " | ring " << ring->Occupancy() << "/" << ring->Depth();
+			if (stats.BufferFill() >= 0) cout << " | stream buffers " << stats.BufferFill();
+			cout << " | worst write " << stats.WorstWriteMs() << " ms";
+			if (cam->trigger) cout << " | discarded " << stats.Discarded();
+			if (cam->compress) cout << " | compression " << stats.CompressionRatio() << ":1, " << stats.CompressMsPerFrame() << " ms/frame";
+			cout << endl;
+		}
+		last = now;
+		lastGrabbed = grabbed;
+	}
+	statsFile.close();
 }
 
+/*
+========================================================================================================================================
+AcquireImages will retrieve images from a frame source (camera, synthetic or replay) and write them into the temporary files. The
+calling thread only grabs frames: each frame is copied into the frame ring and its buffer released immediately, while WriteFrames
+writes the ring to disk.
+========================================================================================================================================
+*/
+int AcquireImages(FrameSource& source, CameraPipeline& cam)
+{
+	int result = 0;
+	if (!source.Start())
+	{
+		lock_guard<mutex> lock(consoleMutex);
+		cout << "Failure: " << cam.serialNumber << ": " << source.Error() << endl;
+		return -1;
+	}
+	{
+		lock_guard<mutex> lock(consoleMutex);
+		cout << endl << "--- Acquiring images from " << cam.serialNumber << ": " << source.Describe() << " ---" << endl << endl;
+	}
+	cam.frameSize = source.FrameSize();
+	InitFileHeader(cam, source.Width(), source.Height(), source.PixelFormatName(), source.ExposureTime(), source.Gain(), source.FPS());
+	// Lossless compression and the motion trigger work on 8-bit frames only
+	const bool eightBit = cam.frameSize == source.Width() * source.Height();
+	cam.compress = compression == 1 && eightBit;
+	if (compression == 1 && !cam.compress)
+	{
+		lock_guard<mutex> lock(consoleMutex);
+		cout << "	" << cam.serialNumber << ": compression needs an 8-bit pixel format, frames are written uncompressed" << endl;
+	}
+	cam.fileHeader.compression = cam.compress ? RODI_COMPRESSION_BAYER : RODI_COMPRESSION_NONE;
+	// The motion trigger holds the pre-roll in the ring on top of the usual slack for disk stalls
+	cam.trigger.reset();
+	if (triggerMode == 1 && eightBit) cam.trigger.reset(new MotionTrigger(source.Width(), source.Height(), source.PixelFormatName(), motionDecimation, motionThreshold, motionPixels));
+	else if (triggerMode == 1)
+	{
+		lock_guard<mutex> lock(consoleMutex);
+		cout << "	" << cam.serialNumber << ": the motion trigger needs an 8-bit pixel format, every frame is stored" << endl;
+	}
+	FrameRing ring(cam.trigger ? preRoll + max(ringDepth, 2) : ringDepth, cam.frameSize, cam.compress);
+	// Start the file, writer and telemetry threads
+	cam.grabDone = false;
+	cam.writeFailed = false;
+	cam.framesRecorded = 0;
+	cam.stats.Reset();
+	atomic<bool> statsDone(false);
+	cam.filesDone = false;
+	cam.segment.reset();
+	cam.nextSegment.reset();
+	cam.fullSegments.clear();
+	thread files(RotateFiles, &cam);
+	thread writer(WriteFrames, &cam, &ring);
+	thread reporter(ReportStats, &cam, &ring, &statsDone);
+	vector<thread> compressors;
+	if (cam.compress)
+	{
+		unsigned int numCompressors = compressionThreads > 0 ? compressionThreads : thread::hardware_concurrency() / 2;
+		if (numCompressors == 0) numCompressors = 1;
+		for (unsigned int i = 0; i < numCompressors; i++)
+		{
+			compressors.push_back(thread(CompressFrames, &cam, &ring));
+		}
+	}
+	const steady_clock::time_point start = steady_clock::now();
+	const unsigned long long k_totalFrames = static_cast<unsigned long long>(totalfiles) * numFrames;
+	for (unsigned long long FrameCnt = 0; FrameCnt < k_totalFrames; FrameCnt++)
+	{
+		SourceFrame frame;
+		GrabResult grabbed = source.Grab(frame);
+		if (grabbed == GRAB_END) break;
+		if (grabbed == GRAB_FAILED)
+		{
+			lock_guard<mutex> lock(consoleMutex);
+			cout << "Failure: " << source.Error() << endl;
+			result = -1;
+			break;
+		}
+		cam.stats.FrameGrabbed(frame.frameID, frame.incomplete);
+		if (FrameCnt % 16 == 0) cam.stats.StreamBufferFill(source.StreamBufferFill());
+		// Copy imageData into the ring and hand the buffer back to the source
+		bool pushed = PushFrame(cam, ring, frame.data, frame.size, frame.frameID, frame.timestamp, frame.incomplete ? k_rodiFrameIncomplete : 0);
+		source.Release();
+		if (!pushed) break;
+		cam.framesRecorded++;
+	}
+	// Let the compression workers and the writer drain the ring before closing the log
+	cam.grabDone = true;
+	for (size_t i = 0; i < compressors.size(); i++)
+	{
+		compressors[i].join();
+	}
+	writer.join();
+	files.join();
+	cam.recordSeconds = duration<double>(steady_clock::now() - start).count();
+	source.Stop();
+	statsDone = true;
+	reporter.join();
+	lock_guard<mutex> lock(consoleMutex);
+	const AcquisitionStats& stats = cam.stats;
+	cout << "	" << cam.serialNumber << ": frame ring high-water mark: " << ring.HighWaterMark() << "/" << ring.Depth() << " frames" << endl;
+	cout << "	" << cam.serialNumber << ": " << cam.framesRecorded << " frames in " << cam.recordSeconds << " s ("
+		<< (cam.recordSeconds > 0 ? cam.framesRecorded / cam.recordSeconds : 0) << " fps, " << FPS << " configured)" << endl;
+	cout << "	" << cam.serialNumber << ": grabbed " << stats.Grabbed() << ", dropped " << stats.Dropped() << ", incomplete " << stats.Incomplete()
+		<< ", written " << stats.Written() << (stats.Dropped() == 0 && stats.Incomplete() == 0 && stats.Written() + stats.Discarded() == stats.Grabbed() ? " (complete)" : " (NOT complete)") << endl;
+	if (cam.trigger)
+	{
+		cout << "	" << cam.serialNumber << ": motion trigger: activity in " << stats.Motion() << " frames, stored " << stats.Written() << " of " << stats.Grabbed() << " frames ("
+			<< (stats.Grabbed() > 0 ? 100.0 * stats.Written() / stats.Grabbed() : 0) << "%), discarded " << stats.Discarded() << endl;
+	}
+	cout << "	" << cam.serialNumber << ": write latency";
+	for (int i = 0; i < AcquisitionStats::k_latencyBuckets; i++)
+	{
+		if (i < AcquisitionStats::k_latencyBuckets - 1) cout << " <" << AcquisitionStats::LatencyLimitMs(i) << " ms: ";
+		else cout << " >=" << AcquisitionStats::LatencyLimitMs(i - 1) << " ms: ";
+		cout << stats.LatencyCount(i);
+	}
+	cout << endl;
+	if (cam.compress)
+	{
+		cout << "	" << cam.serialNumber << ": compression ratio " << stats.CompressionRatio() << ", " << stats.CompressMsPerFrame() << " ms per frame on "
+			<< compressors.size() << " worker threads" << endl;
+	}
+	if (cam.writeFailed) result = -1;
+	return result;
+}
 
 /*
 ========================================================================================================================================
@@ -624,26 +1251,24 @@ int InitializeCamera(CameraPtr pCam, string serialNumber)
 	int result = 0;
 	try
 	{
-		BufferHandlingSettings(pCam); // Set Buffer
-		ConfigureFramerate(pCam); // Set Framerate
-		ConfigureExposure(pCam); // Set Exposure
-		ConfigureGain(pCam); // SetGain
-		CleanBuffer(pCam); // Clean buffer
+		result = result | BufferHandlingSettings(pCam); // Set Buffer
+		result = result | ConfigureFramerate(pCam); // Set Framerate
+		result = result | ConfigureExposure(pCam); // Set Exposure
+		result = result | ConfigureGain(pCam); // SetGain
+		result = result | CleanBuffer(pCam); // Clean buffer
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		return -1;
+		return CameraFailure(e.what());
 	}
+	lock_guard<mutex> lock(consoleMutex);
 	cout << endl << "--- Camera parameters have been set! ---" << endl;
 	return result;
 }
 
-int RunCamera(CameraPtr pCam)
+int RunCamera(CameraPtr pCam, CameraPipeline& cam)
 {
-	int result;
+	int result = 0;
 	try
 	{
 		// Initialize camera
@@ -654,40 +1279,173 @@ int RunCamera(CameraPtr pCam)
 		CStringPtr ptrStringSerial = pCam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
 		if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
 		{
-			serialNumber = ptrStringSerial->GetValue();
+			cam.serialNumber = ptrStringSerial->GetValue();
 		}
-		// Set DeviceUserID to loop counter to assign camera order to cameraFiles in parallel threads
+		// Set DeviceUserID to loop counter to assign camera order to camera files in parallel threads
 		CStringPtr ptrDeviceUserId = nodeMap.GetNode("DeviceUserID");
 		if (!IsAvailable(ptrDeviceUserId) || !IsWritable(ptrDeviceUserId))
 		{
-			cout << "Failure: Unable to get node ptrDeviceUserId. Press enter to exit." << endl << endl;
-			getchar();
-			return -1;
+			return CameraFailure("Unable to get node ptrDeviceUserId.");
 		}
 		// camera setup based on myconfig.txt parameters
-		result = result | InitializeCamera(pCam, serialNumber);
+		result = result | InitializeCamera(pCam, cam.serialNumber);
 		// Acquire images
-		result = result | AcquireImages(pCam, nodeMap, nodeMapTLDevice);
+		SpinnakerSource source(pCam, nodeMap);
+		result = result | AcquireImages(source, cam);
 		// Deinitialize camera
 		pCam->DeInit();
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Failure: " << e.what() << endl;
-		cout << "Press enter to exit." << endl << endl;
-		getchar();
-		result = -1;
+		result = CameraFailure(e.what());
 	}
 	return result;
 }
 
+vector<string> ReplayFiles(unsigned int camNr) // .tmp files replayed by simulated camera camNr: the recording of the camNr-th camera found in replayPath
+{
+	fs::path replay(replayPath);
+	if (fs::is_regular_file(replay)) return vector<string>(1, replay.string());
+	map<string, vector<string>> recordings; // .tmp files per serial number
+	if (fs::is_directory(replay))
+	{
+		for (auto i = fs::directory_iterator(replay); i != fs::directory_iterator(); i++)
+		{
+			if (is_directory(i->path()) || i->path().extension() != ".tmp") continue;
+			const string filename = i->path().filename().string();
+			recordings[filename.substr(0, filename.rfind("_file"))].push_back(i->path().string());
+		}
+	}
+	if (recordings.empty()) return vector<string>();
+	auto recording = recordings.begin();
+	advance(recording, camNr % recordings.size());
+	sort(recording->second.begin(), recording->second.end()); // file numbers are zero padded (FileNr)
+	return recording->second;
+}
+
+/*
+========================================================================================================================================
+RunPipeline records camera camNr into its own pipeline (file set, log and frame ring), either from the attached camera or from a
+simulated camera (synthetic frames or a replayed recording) when simulatedCameras is set.
+========================================================================================================================================
+*/
+int RunPipeline(CameraPtr pCam, CameraPipeline& cam, unsigned int camNr)
+{
+	if (simulatedCameras > 0)
+	{
+		cam.serialNumber = "SIM" + to_string(camNr);
+		if (simulatedSource == "replay")
+		{
+			ReplaySource source(ReplayFiles(camNr), benchmarkMode ? 0 : replaySpeed, simWidth, simHeight, FPS);
+			return AcquireImages(source, cam);
+		}
+		SyntheticSource source(simWidth, simHeight, benchmarkMode ? 0 : FPS, exposureTime, dGain);
+		return AcquireImages(source, cam);
+	}
+	return RunCamera(pCam, cam);
+}
+
+/*
+========================================================================================================================================
+RecordCameras runs one pipeline per camera, all at the same time (multiCamera = 1) or one after another.
+========================================================================================================================================
+*/
+int RecordCameras(vector<CameraPtr>& cameras, vector<unique_ptr<CameraPipeline>>& pipelines)
+{
+	int result = 0;
+	const unsigned int numCameras = static_cast<unsigned int>(pipelines.size());
+	if (multiCamera == 1 && numCameras > 1)
+	{
+		// Run all cameras at the same time, each in its own thread
+		cout << endl << "--- Starting " << numCameras << " cameras concurrently ---" << endl;
+		vector<int> results(numCameras, 0);
+		vector<thread> cameraThreads;
+		for (unsigned int i = 0; i < numCameras; i++)
+		{
+			cameraThreads.push_back(thread([&, i]() { results[i] = RunPipeline(cameras[i], *pipelines[i], i); }));
+		}
+		for (unsigned int i = 0; i < numCameras; i++)
+		{
+			cameraThreads[i].join();
+			result = result | results[i];
+		}
+		cout << endl << "--- Recording complete! ---" << endl << endl;
+	}
+	else
+	{
+		// Run the script for each camera
+		for (unsigned int i = 0; i < numCameras; i++)
+		{
+			cout << endl << "--- Starting camera " << i << " ---" << endl;
+			result = result | RunPipeline(cameras[i], *pipelines[i], i);
+			cout << endl << "--- Recording complete! ---" << endl << endl;
+		}
+	}
+	return result;
+}
+
+/*
+========================================================================================================================================
+Benchmark records simulatedCameras (at least one) simulated cameras into folder with pacing disabled, so every camera delivers frames as
+fast as the frame ring and the writer thread accept them. The achieved rate is the maximum sustainable FPS of this machine and disk.
+========================================================================================================================================
+*/
+int Benchmark(string folder, string config)
+{
+	outpath = folder;
+	cout << endl << "--- Importing parameters from " + config + " ---";
+	if (readconfig(config) == -1) return -1;
+	cout << "	Complete!" << endl << endl;
+	benchmarkMode = true;
+	if (simulatedCameras == 0) simulatedCameras = 1;
+	vector<CameraPtr> cameras(simulatedCameras, nullptr);
+	vector<unique_ptr<CameraPipeline>> pipelines;
+	for (int i = 0; i < simulatedCameras; i++)
+	{
+		pipelines.push_back(unique_ptr<CameraPipeline>(new CameraPipeline()));
+	}
+	int result = RecordCameras(cameras, pipelines);
+	double minFPS = 0;
+	double totalBytes = 0;
+	double maxSeconds = 0;
+	cout << "--- Benchmark results (" << simulatedSource << " source, " << (multiCamera == 1 ? "concurrent" : "sequential") << ", "
+		<< (directIO == 1 ? "direct I/O" : "buffered I/O") << ") ---" << endl;
+	for (size_t i = 0; i < pipelines.size(); i++)
+	{
+		const CameraPipeline& cam = *pipelines[i];
+		const double camFPS = cam.recordSeconds > 0 ? cam.framesRecorded / cam.recordSeconds : 0;
+		const double bytes = static_cast<double>(cam.framesRecorded) * cam.frameSize;
+		cout << "	" << cam.serialNumber << ": " << camFPS << " fps, " << (cam.recordSeconds > 0 ? bytes / 1e6 / cam.recordSeconds : 0) << " MB/s" << endl;
+		if (i == 0 || camFPS < minFPS) minFPS = camFPS;
+		totalBytes += bytes;
+		if (cam.recordSeconds > maxSeconds) maxSeconds = cam.recordSeconds;
+	}
+	cout << "	Maximum sustainable frame rate: " << minFPS << " fps per camera";
+	if (multiCamera == 1) cout << " with " << pipelines.size() << " cameras, " << (maxSeconds > 0 ? totalBytes / 1e6 / maxSeconds : 0) << " MB/s in total";
+	cout << endl;
+	if (result != 0) cout << "Failure: at least one simulated camera did not complete its recording." << endl;
+	return result;
+}
+
 /*
 ========================================================================================================================================
 Main function of the script. In here the output folder is defined, myconfig.txt is loaded and the camera started for image acquisition.
 ========================================================================================================================================
 */
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
+	// RODI_REC --export-csv <folder> [--stored] regenerates the .csv log files from the frame indexes and exits, --stored adds whether each frame was stored
+	if ((argc == 3 || (argc == 4 && string(argv[3]) == "--stored")) && string(argv[1]) == "--export-csv")
+	{
+		cout << endl << "--- Exporting .csv log files from frame indexes in " << argv[2] << " ---" << endl;
+		return ExportCSV(argv[2], argc == 4);
+	}
+	// RODI_REC --benchmark <folder> <myconfig.txt> measures the maximum sustainable FPS of the recording pipeline and exits
+	if (argc == 4 && string(argv[1]) == "--benchmark")
+	{
+		cout << endl << "--- Benchmarking the recording pipeline in " << argv[2] << " ---" << endl;
+		return Benchmark(argv[2], argv[3]);
+	}
 	// Print application build information
 	cout << "*************************************************************" << endl;
 	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
@@ -724,6 +1482,12 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 	fclose(tempFile);
 	remove(testfile);
 	cout << "	Complete!" << endl << endl;
+	// Read config file and update parameters
+	cout << "Provide the path to the myconfig.txt file (path format example: C:\\RODI\\myconfig.txt) " << endl;
+	getline(cin, myconfig);
+	cout << endl << "--- Importing parameters from " + myconfig + " ---";
+	readconfig(myconfig);
+	cout << "	Complete!" << endl << endl;
 	// Retrieve singleton reference to system object
 	SystemPtr system = System::GetInstance();
 	// Print out current library version
@@ -733,7 +1497,7 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 		<< endl;
 	// Checl the system for attached cameras
 	CameraList camList = system->GetCameras();
-	const unsigned int numCameras = camList.GetSize();
+	const unsigned int numCameras = simulatedCameras > 0 ? simulatedCameras : camList.GetSize();
 	cout << "--- Number of cameras detected: " << numCameras << " ---" << endl << endl;
 	// Exit if no camera's are present
 	if (numCameras == 0)
@@ -747,26 +1511,21 @@ ____/\\\\\\\\\___________/\\\\\_______/\\\\\\\\\\\\_____/\\\\\\\\\\\_
 		getchar();
 		return -1;
 	}
-	// Read config file and update parameters
-	cout << "Provide the path to the myconfig.txt file (path format example: C:\\RODI\\myconfig.txt) " << endl;
-	getline(cin, myconfig);
-	cout << endl << "--- Importing parameters from " + myconfig + " ---";
-	readconfig(myconfig);
-	cout << "	Complete!" << endl << endl;
-	// Create shared pointer to camera
-	CameraPtr pCam = nullptr;
-	int result = 0;
-	// Run the script for each camera
+	// Create shared pointers to the cameras and one pipeline per camera
+	vector<CameraPtr> cameras(numCameras, nullptr);
+	vector<unique_ptr<CameraPipeline>> pipelines;
 	for (unsigned int i = 0; i < numCameras; i++)
 	{
-		// Select camera
-		pCam = camList.GetByIndex(i);
-		cout << endl << "--- Starting camera " << i << " ---" << endl;
-		result = result | RunCamera(pCam);
-		cout << endl << "--- Recording complete! ---" << endl << endl;
+		if (simulatedCameras == 0) cameras[i] = camList.GetByIndex(i);
+		pipelines.push_back(unique_ptr<CameraPipeline>(new CameraPipeline()));
+	}
+	int result = RecordCameras(cameras, pipelines);
+	if (result != 0)
+	{
+		cout << "Failure: at least one camera did not complete its recording." << endl;
 	}
-	// Release reference to the camera
-	pCam = nullptr;
+	// Release references to the cameras
+	cameras.clear();
 	// Clear camera list before releasing system
 	camList.Clear();
 	// Release system
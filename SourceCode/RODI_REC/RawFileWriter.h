@@ -0,0 +1,279 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (Recording script)
+// RawFileWriter writes the .tmp files of RODI_REC. Each file is preallocated for its expected size and written in page-aligned blocks
+// from an aligned staging buffer with direct I/O (FILE_FLAG_NO_BUFFERING on Windows, O_DIRECT on Linux), so frames bypass the page
+// cache. If the filesystem refuses direct I/O the writer falls back to buffered I/O with a bounded writeback window (write-through on
+// Windows, sync_file_range on Linux). Per file it keeps the sustained MB/s and the worst-case latency of a single block write.
+//========================================================================================================================================
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+class RawFileWriter
+{
+public:
+	static const size_t k_alignment = 4096; // covers 512 byte and 4K sector drives
+	static const size_t k_stagingSize = 4 * 1024 * 1024; // bytes collected before a block is written
+	static const uint64_t k_writebackWindow = 64ull * 1024 * 1024; // dirty bytes allowed in buffered fallback mode
+
+	RawFileWriter() : staging(nullptr), fill(0), fileOffset(0), logicalSize(0), preallocated(0), directIO(false), open(false), lastWriteback(0),
+		worstWriteNs(0), writeNs(0)
+	{
+#ifdef _WIN32
+		handle = INVALID_HANDLE_VALUE;
+		staging = static_cast<char*>(_aligned_malloc(k_stagingSize, k_alignment));
+#else
+		fd = -1;
+		void* p = nullptr;
+		if (posix_memalign(&p, k_alignment, k_stagingSize) == 0) staging = static_cast<char*>(p);
+#endif
+	}
+
+	~RawFileWriter()
+	{
+		if (open) Close();
+#ifdef _WIN32
+		_aligned_free(staging);
+#else
+		free(staging);
+#endif
+	}
+
+	/*
+	Open creates the file and reserves preallocateBytes on disk. Direct I/O is used when useDirectIO is set and supported by the
+	filesystem, otherwise the file is opened for buffered I/O with bounded writeback.
+	*/
+	bool Open(const std::string& filename, uint64_t preallocateBytes, bool useDirectIO)
+	{
+		if (open || staging == nullptr) return false;
+		path = filename;
+		fill = 0;
+		fileOffset = 0;
+		logicalSize = 0;
+		lastWriteback = 0;
+		worstWriteNs = 0;
+		writeNs = 0;
+		directIO = useDirectIO && OpenHandle(true);
+		if (!directIO && !OpenHandle(false)) return false;
+		preallocated = preallocateBytes;
+		Preallocate(preallocated);
+		open = true;
+		opened = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	// Write appends size bytes. Full aligned blocks go to disk as soon as the staging buffer is full.
+	bool Write(const void* data, size_t size)
+	{
+		if (!open) return false;
+		const char* src = static_cast<const char*>(data);
+		while (size > 0)
+		{
+			size_t chunk = k_stagingSize - fill;
+			if (chunk > size) chunk = size;
+			memcpy(staging + fill, src, chunk);
+			fill += chunk;
+			src += chunk;
+			size -= chunk;
+			logicalSize += chunk;
+			if (fill == k_stagingSize && !WriteBlock(k_stagingSize)) return false;
+		}
+		return true;
+	}
+
+	// Flush writes the whole aligned blocks waiting in the staging buffer, so readers of the file see them before the buffer is full
+	bool Flush()
+	{
+		if (!open) return false;
+		const size_t aligned = fill / k_alignment * k_alignment;
+		if (aligned == 0) return true;
+		const size_t rest = fill - aligned;
+		const bool ok = WriteBlock(aligned);
+		memmove(staging, staging + aligned, rest);
+		fill = rest;
+		return ok;
+	}
+
+	// Close writes the remaining bytes padded to the alignment, trims the file to its logical size and closes it.
+	bool Close()
+	{
+		if (!open) return false;
+		bool ok = true;
+		if (fill > 0)
+		{
+			const size_t padded = (fill + k_alignment - 1) / k_alignment * k_alignment;
+			memset(staging + fill, 0, padded - fill);
+			ok = WriteBlock(padded);
+		}
+		ok = Truncate(logicalSize) && ok;
+		CloseFile();
+		closed = std::chrono::steady_clock::now();
+		open = false;
+		return ok;
+	}
+
+	// RestartClock starts the sustained MB/s measurement anew, for a file opened ahead of time and written later
+	void RestartClock() { opened = std::chrono::steady_clock::now(); }
+
+	bool IsOpen() const { return open; }
+	bool DirectIO() const { return directIO; }
+	const std::string& Path() const { return path; }
+	uint64_t BytesWritten() const { return logicalSize; }
+	double WorstWriteMs() const { return worstWriteNs / 1e6; }
+	double SustainedMBps() const // MB/s from Open() to Close() (or now if still open)
+	{
+		const std::chrono::steady_clock::time_point end = open ? std::chrono::steady_clock::now() : closed;
+		const double seconds = std::chrono::duration<double>(end - opened).count();
+		return seconds > 0 ? logicalSize / 1e6 / seconds : 0;
+	}
+
+private:
+	RawFileWriter(const RawFileWriter&) = delete;
+	RawFileWriter& operator=(const RawFileWriter&) = delete;
+
+	bool WriteBlock(size_t bytes)
+	{
+		const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool ok = WriteAt(staging, bytes, fileOffset);
+		if (!ok && directIO && fileOffset == 0)
+		{
+			// the filesystem accepted the direct I/O open but not the write, continue with buffered I/O
+			CloseFile();
+			directIO = false;
+			ok = OpenHandle(false);
+			if (ok)
+			{
+				Preallocate(preallocated);
+				ok = WriteAt(staging, bytes, fileOffset);
+			}
+		}
+		const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+		writeNs += ns;
+		if (ns > worstWriteNs) worstWriteNs = ns;
+		fileOffset += bytes;
+		fill = 0;
+		if (ok && !directIO && fileOffset - lastWriteback >= k_writebackWindow) BoundWriteback();
+		return ok;
+	}
+
+#ifdef _WIN32
+	bool OpenHandle(bool noBuffering)
+	{
+		const DWORD flags = noBuffering ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_WRITE_THROUGH | FILE_FLAG_SEQUENTIAL_SCAN;
+		handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | flags, NULL);
+		return handle != INVALID_HANDLE_VALUE;
+	}
+	void Preallocate(uint64_t bytes)
+	{
+		// reserve clusters without moving end-of-file, so sequential writes never zero-fill
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = static_cast<LONGLONG>(bytes);
+		SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info));
+	}
+	bool WriteAt(const char* data, size_t bytes, uint64_t offset)
+	{
+		OVERLAPPED ov = {};
+		ov.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+		ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD written = 0;
+		return WriteFile(handle, data, static_cast<DWORD>(bytes), &written, &ov) && written == bytes;
+	}
+	bool Truncate(uint64_t size)
+	{
+		FILE_END_OF_FILE_INFO info;
+		info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+		return SetFileInformationByHandle(handle, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+	}
+	void BoundWriteback() { lastWriteback = fileOffset; } // the write-through handle already bounds dirty data
+	void CloseFile()
+	{
+		CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+	}
+	HANDLE handle;
+#else
+	bool OpenHandle(bool noBuffering)
+	{
+		int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+		if (noBuffering) flags |= O_DIRECT;
+#else
+		if (noBuffering) return false;
+#endif
+		fd = ::open(path.c_str(), flags, 0644);
+		return fd >= 0;
+	}
+	void Preallocate(uint64_t bytes)
+	{
+		if (bytes > 0) posix_fallocate(fd, 0, static_cast<off_t>(bytes)); // not supported everywhere, only a hint
+	}
+	bool WriteAt(const char* data, size_t bytes, uint64_t offset)
+	{
+		while (bytes > 0)
+		{
+			const ssize_t n = pwrite(fd, data, bytes, static_cast<off_t>(offset));
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			data += n;
+			bytes -= static_cast<size_t>(n);
+			offset += static_cast<uint64_t>(n);
+		}
+		return true;
+	}
+	bool Truncate(uint64_t size) { return ftruncate(fd, static_cast<off_t>(size)) == 0; }
+	void BoundWriteback()
+	{
+		// start writeback of the newest window and wait for the previous one, then drop it from the page cache
+#ifdef SYNC_FILE_RANGE_WRITE
+		sync_file_range(fd, static_cast<off_t>(lastWriteback), static_cast<off_t>(fileOffset - lastWriteback), SYNC_FILE_RANGE_WRITE);
+		if (lastWriteback >= k_writebackWindow)
+		{
+			const off_t previous = static_cast<off_t>(lastWriteback - k_writebackWindow);
+			sync_file_range(fd, previous, static_cast<off_t>(k_writebackWindow), SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(fd, previous, static_cast<off_t>(k_writebackWindow), POSIX_FADV_DONTNEED);
+		}
+#else
+		fdatasync(fd);
+#endif
+		lastWriteback = fileOffset;
+	}
+	void CloseFile()
+	{
+		::close(fd);
+		fd = -1;
+	}
+	int fd;
+#endif
+
+	std::string path;
+	char* staging; // k_alignment aligned staging buffer of k_stagingSize bytes
+	size_t fill; // bytes waiting in the staging buffer
+	uint64_t fileOffset; // bytes handed to the operating system (always aligned)
+	uint64_t logicalSize; // bytes written by the caller
+	uint64_t preallocated; // bytes reserved on disk when the file was opened
+	bool directIO;
+	bool open;
+	uint64_t lastWriteback; // file offset up to which writeback was started (buffered mode)
+	long long worstWriteNs;
+	long long writeNs;
+	std::chrono::steady_clock::time_point opened;
+	std::chrono::steady_clock::time_point closed;
+};
@@ -0,0 +1,81 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// Background processing next to a running recording. EnterBackgroundMode lowers the CPU and I/O priority of the process, so RODI_CONV and
+// RODI_BoundB only use what RODI_REC leaves over: PROCESS_MODE_BACKGROUND_BEGIN on Windows (low CPU, I/O and memory priority), nice 19
+// and the lowest best-effort I/O priority on Linux. The idle I/O class is not used on Linux, as it would stop the follow mode altogether
+// while RODI_REC writes continuously. IoThrottle additionally caps the read rate of the .tmp files.
+//========================================================================================================================================
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+EnterBackgroundMode lowers the priority of the calling process. On Linux the priorities belong to the calling thread and are inherited by
+the threads it starts, so it must be called before any worker thread is started. Returns false if the priority could not be lowered.
+*/
+inline bool EnterBackgroundMode()
+{
+#ifdef _WIN32
+	if (SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN)) return true;
+	return SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS) != 0;
+#else
+	bool ok = setpriority(PRIO_PROCESS, 0, 19) == 0;
+#ifdef SYS_ioprio_set
+	const int k_ioprioWhoProcess = 1;
+	const int k_ioprioClassBestEffort = 2;
+	const int k_ioprioClassShift = 13;
+	ok = syscall(SYS_ioprio_set, k_ioprioWhoProcess, 0, (k_ioprioClassBestEffort << k_ioprioClassShift) | 7) == 0 && ok;
+#endif
+	return ok;
+#endif
+}
+
+// IoThrottle paces the reads of all threads to at most a given number of bytes per second
+class IoThrottle
+{
+public:
+	IoThrottle() : bytesPerSecond(0), next(std::chrono::steady_clock::now()) {}
+
+	// SetLimit sets the rate limit in bytes per second, 0 = no limit
+	void SetLimit(uint64_t limit)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bytesPerSecond = limit;
+		next = std::chrono::steady_clock::now();
+	}
+
+	uint64_t Limit() const { return bytesPerSecond; }
+
+	// Acquire waits until bytes may be read within the limit
+	void Acquire(uint64_t bytes)
+	{
+		std::chrono::steady_clock::time_point start;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (bytesPerSecond == 0) return;
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (next < now - std::chrono::seconds(1)) next = now - std::chrono::seconds(1); // at most one second of unused rate is kept
+			start = next;
+			next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(static_cast<double>(bytes) / bytesPerSecond));
+		}
+		std::this_thread::sleep_until(start);
+	}
+
+private:
+	std::mutex mutex;
+	uint64_t bytesPerSecond;
+	std::chrono::steady_clock::time_point next; // when the next read may start
+};
@@ -0,0 +1,284 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// Lossless codec for 8-bit Bayer frames, used by RODI_REC (compression = 1) and decoded by RodiRawReader.
+//
+// Every pixel is predicted from its neighbours in the same CFA plane (two pixels to the left, two pixels up and diagonal), using the
+// median edge detector of LOCO-I, so the predictor never mixes red, green and blue samples. The prediction residuals are mapped to
+// non-negative values and written with an adaptive Rice code per CFA plane. A static river background leaves small residuals that cost
+// a few bits per pixel. The payload is a plain bit stream, width and height come from the RodiFileHeader.
+//========================================================================================================================================
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+class BayerCodec
+{
+public:
+	static const uint32_t k_escape = 24; // unary prefixes of this length are followed by the raw residual
+
+	/*
+	Encode compresses a width x height 8-bit frame into out (resized to the compressed size). Returns false, and leaves out undefined,
+	if the compressed frame would not be smaller than the raw frame.
+	*/
+	static bool Encode(const uint8_t* src, size_t width, size_t height, std::vector<uint8_t>& out)
+	{
+		const size_t limit = width * height;
+		out.resize(limit + 4 * width + 64); // a row codes to at most 32 bits per pixel
+		BitWriter bits(out.data());
+		Context ctx[4];
+		for (size_t y = 0; y < height; y++)
+		{
+			const uint8_t* row = src + y * width;
+			const uint8_t* up = y >= 2 ? row - 2 * width : nullptr;
+			Context* rowCtx = &ctx[(y & 1) * 2];
+			for (size_t x = 0; x < width && x < 2; x++)
+			{
+				EncodePixel(bits, rowCtx[x & 1], row[x] - PredictBorder(row, up, x));
+			}
+			if (up == nullptr)
+			{
+				for (size_t x = 2; x < width; x++)
+				{
+					EncodePixel(bits, rowCtx[x & 1], row[x] - row[x - 2]);
+				}
+			}
+			else
+			{
+				for (size_t x = 2; x < width; x++)
+				{
+					EncodePixel(bits, rowCtx[x & 1], row[x] - Predict(row[x - 2], up[x], up[x - 2]));
+				}
+			}
+			if (bits.Size() >= limit) return false;
+		}
+		out.resize(bits.Finish());
+		return out.size() < limit;
+	}
+
+	// Decode restores a width x height frame into dst. Returns false if the stream is corrupt or too short.
+	static bool Decode(const uint8_t* src, size_t srcSize, size_t width, size_t height, uint8_t* dst)
+	{
+		BitReader bits(src, srcSize);
+		Context ctx[4];
+		for (size_t y = 0; y < height; y++)
+		{
+			uint8_t* row = dst + y * width;
+			const uint8_t* up = y >= 2 ? row - 2 * width : nullptr;
+			Context* rowCtx = &ctx[(y & 1) * 2];
+			for (size_t x = 0; x < width && x < 2; x++)
+			{
+				row[x] = static_cast<uint8_t>(PredictBorder(row, up, x) + DecodePixel(bits, rowCtx[x & 1]));
+			}
+			if (up == nullptr)
+			{
+				for (size_t x = 2; x < width; x++)
+				{
+					row[x] = static_cast<uint8_t>(row[x - 2] + DecodePixel(bits, rowCtx[x & 1]));
+				}
+			}
+			else
+			{
+				for (size_t x = 2; x < width; x++)
+				{
+					row[x] = static_cast<uint8_t>(Predict(row[x - 2], up[x], up[x - 2]) + DecodePixel(bits, rowCtx[x & 1]));
+				}
+			}
+			if (bits.Overrun()) return false;
+		}
+		return true;
+	}
+
+private:
+	struct Context;
+	class BitWriter;
+	class BitReader;
+
+	static inline int BitLength(uint32_t value) // position of the highest set bit plus one, 0 for 0
+	{
+		if (value == 0) return 0;
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return static_cast<int>(index) + 1;
+#else
+		return 32 - __builtin_clz(value);
+#endif
+	}
+
+	// Predict returns the LOCO-I median edge prediction from the same CFA plane (a = left, b = up, c = up-left), written as a clamp of
+	// the planar prediction a + b - c to [min(a, b), max(a, b)] so it compiles without branches
+	static inline int Predict(int a, int b, int c)
+	{
+		const int mn = a < b ? a : b;
+		const int mx = a < b ? b : a;
+		const int planar = a + b - c;
+		const int clamped = planar < mn ? mn : planar;
+		return clamped > mx ? mx : clamped;
+	}
+
+	// PredictBorder predicts the first row and the first column of each CFA plane
+	static inline int PredictBorder(const uint8_t* row, const uint8_t* up, size_t x)
+	{
+		if (up == nullptr) return x >= 2 ? row[x - 2] : 0;
+		if (x < 2) return up[x];
+		return Predict(row[x - 2], up[x], up[x - 2]);
+	}
+
+	// EncodePixel writes the prediction error (modulo 256) with the Rice parameter of its context
+	static inline void EncodePixel(BitWriter& bits, Context& c, int error)
+	{
+		const int residual = static_cast<int8_t>(static_cast<uint8_t>(error));
+		const uint32_t mapped = residual >= 0 ? 2 * residual : -2 * residual - 1;
+		const uint32_t k = c.K();
+		const uint32_t q = mapped >> k;
+		if (q < k_escape)
+		{
+			bits.Put((((1u << q) - 1) << (k + 1)) | (mapped & ((1u << k) - 1)), q + 1 + k); // q ones, a terminating zero and k low bits
+		}
+		else
+		{
+			bits.Put((1u << k_escape) - 1, k_escape);
+			bits.Put(mapped, 8);
+		}
+		c.Update(mapped);
+	}
+
+	// DecodePixel reads one prediction error
+	static inline int DecodePixel(BitReader& bits, Context& c)
+	{
+		const uint32_t k = c.K();
+		const uint32_t q = bits.LeadingOnes(k_escape);
+		uint32_t mapped;
+		if (q < k_escape)
+		{
+			mapped = (q << k) | (bits.Get(k + 1) & ((1u << k) - 1)); // terminating zero and k low bits
+		}
+		else
+		{
+			mapped = bits.Get(8);
+		}
+		c.Update(mapped);
+		return (mapped & 1) ? -static_cast<int>((mapped + 1) >> 1) : static_cast<int>(mapped >> 1);
+	}
+
+	// Context keeps the running mean of the mapped residuals of one CFA plane to choose the Rice parameter
+	struct Context
+	{
+		uint32_t A = 4; // sum of mapped residuals
+		uint32_t N = 1; // number of residuals
+		inline uint32_t K() const // smallest k with N * 2^k >= A, at most 7
+		{
+			int k = BitLength(A) - BitLength(N);
+			if (k < 0) k = 0;
+			if ((N << k) < A) k++;
+			return k > 7 ? 7 : static_cast<uint32_t>(k);
+		}
+		inline void Update(uint32_t mapped)
+		{
+			A += mapped;
+			if (++N == 64)
+			{
+				A >>= 1;
+				N >>= 1;
+			}
+		}
+	};
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(uint8_t* buffer) : out(buffer), pos(0), acc(0), count(0) {}
+		inline void Put(uint32_t value, uint32_t numBits) // numBits <= 32, most significant bit first
+		{
+			acc = (acc << numBits) | value;
+			count += numBits;
+			if (count >= 32)
+			{
+				count -= 32;
+				const uint32_t word = static_cast<uint32_t>(acc >> count);
+				out[pos] = static_cast<uint8_t>(word >> 24);
+				out[pos + 1] = static_cast<uint8_t>(word >> 16);
+				out[pos + 2] = static_cast<uint8_t>(word >> 8);
+				out[pos + 3] = static_cast<uint8_t>(word);
+				pos += 4;
+			}
+		}
+		size_t Size() const { return pos; }
+		size_t Finish()
+		{
+			while (count >= 8)
+			{
+				count -= 8;
+				out[pos++] = static_cast<uint8_t>(acc >> count);
+			}
+			if (count > 0) out[pos++] = static_cast<uint8_t>(acc << (8 - count));
+			count = 0;
+			return pos;
+		}
+	private:
+		uint8_t* out;
+		size_t pos;
+		uint64_t acc; // pending bits in the low count bits
+		uint32_t count;
+	};
+
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* buffer, size_t size) : in(buffer), end(size), pos(0), acc(0), count(0), consumed(0) { Refill(); }
+		// LeadingOnes returns the number of 1 bits before the next 0 bit, at most limit (<= 32), and consumes them
+		inline uint32_t LeadingOnes(uint32_t limit)
+		{
+			uint32_t n = CountLeadingZeros(~acc);
+			if (n > limit) n = limit;
+			Skip(n);
+			return n;
+		}
+		inline uint32_t Get(uint32_t numBits) // 0 < numBits <= 32
+		{
+			const uint32_t value = static_cast<uint32_t>(acc >> (64 - numBits));
+			Skip(numBits);
+			return value;
+		}
+		bool Overrun() const { return consumed > static_cast<uint64_t>(end) * 8; }
+	private:
+		static inline uint32_t CountLeadingZeros(uint64_t value)
+		{
+			if (value == 0) return 64;
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse64(&index, value);
+			return 63 - index;
+#else
+			return static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+		}
+		inline void Skip(uint32_t numBits)
+		{
+			acc <<= numBits;
+			count -= numBits;
+			consumed += numBits;
+			if (count < 32) Refill();
+		}
+		inline void Refill() // keeps at least 57 bits in the window, zeros past the end of the stream
+		{
+			while (count <= 56)
+			{
+				acc |= static_cast<uint64_t>(pos < end ? in[pos] : 0) << (56 - count);
+				pos++;
+				count += 8;
+			}
+		}
+		const uint8_t* in;
+		size_t end;
+		size_t pos;
+		uint64_t acc; // next bits, most significant bit first
+		uint32_t count; // valid bits in acc
+		uint64_t consumed; // bits read so far
+	};
+};
@@ -0,0 +1,81 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// BoundedQueue is a blocking first-in-first-out queue with a fixed capacity, used between the stages of the RODI_CONV conversion
+// pipeline and of the RODI_BoundB detection. Push waits while the queue is full, so a fast stage can never run ahead of a slow one by
+// more than the capacity, and Pop waits while it is empty. Close wakes up all waiting threads: Push then fails, Pop returns the remaining
+// items and fails once the queue is empty.
+//========================================================================================================================================
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+template <class T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t queueCapacity) : capacity(queueCapacity < 1 ? 1 : queueCapacity), closed(false) {}
+
+	// Push appends item, waiting for room. Returns false if the queue was closed.
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+		if (closed) return false;
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Pop removes the oldest item, waiting for one. Returns false once the queue is closed and empty.
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+		if (items.empty()) return false;
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	// TryPop removes the oldest item if there is one, without waiting.
+	bool TryPop(T& item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty()) return false;
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+
+	size_t Size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return items.size();
+	}
+
+	size_t Capacity() const { return capacity; }
+
+private:
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	const size_t capacity;
+	bool closed;
+	std::deque<T> items;
+	mutable std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+};
@@ -0,0 +1,431 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// Demosaic converts 8-bit Bayer frames (BayerRG8, BayerGR8, BayerGB8, BayerBG8) to BGR8 without the Spinnaker SDK.
+//
+//	DEMOSAIC_BILINEAR	missing colours are the rounded mean of the nearest pixels of that colour
+//	DEMOSAIC_EDGE		edge-aware: green is interpolated along the direction with the smaller gradient and corrected with the
+//						laplacian of the recorded colour (Hamilton-Adams); red and blue interpolate the colour differences to green,
+//						so colour edges follow the sharper green plane
+//
+// The interior of the frame runs on AVX2 or SSE4.1 row kernels (DemosaicKernels.inl), chosen at runtime from what the processor supports,
+// with a scalar fallback. The two pixel border reads mirrored pixels (reflect 101). The rows are split into bands converted on separate
+// threads. Reference() is a plain per-pixel implementation of the same formulas; every instruction set must reproduce it exactly.
+//========================================================================================================================================
+
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include "RodiRawFormat.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RODI_DEMOSAIC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+enum DemosaicMethod
+{
+	DEMOSAIC_BILINEAR = 0,
+	DEMOSAIC_EDGE = 1
+};
+
+enum DemosaicIsa
+{
+	DEMOSAIC_SCALAR = 0,
+	DEMOSAIC_SSE41 = 1,
+	DEMOSAIC_AVX2 = 2
+};
+
+#ifdef RODI_DEMOSAIC_X86
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+namespace DemosaicSse41
+{
+#define RODI_DEMOSAIC_LANES 8
+#include "DemosaicKernels.inl"
+#undef RODI_DEMOSAIC_LANES
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace DemosaicAvx2
+{
+#define RODI_DEMOSAIC_LANES 16
+#include "DemosaicKernels.inl"
+#undef RODI_DEMOSAIC_LANES
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif
+
+class Demosaic
+{
+public:
+	/*
+	Demosaic prepares a converter. threads = 0 uses one thread per logical processor; isa defaults to the best instruction set of this
+	processor and is lowered to what the processor supports.
+	*/
+	explicit Demosaic(DemosaicMethod demosaicMethod = DEMOSAIC_EDGE, unsigned threads = 0, DemosaicIsa demosaicIsa = BestIsa())
+		: method(demosaicMethod), numThreads(threads > 0 ? threads : std::thread::hardware_concurrency()), isa(demosaicIsa < BestIsa() ? demosaicIsa : BestIsa())
+	{
+		if (numThreads < 1) numThreads = 1;
+	}
+
+	/*
+	Convert demosaics a width x height Bayer frame (rows srcStride bytes apart) to BGR8 (rows dstStride bytes apart). Returns false if
+	pixelFormat is not a Bayer format or the frame is smaller than 4 x 4 pixels.
+	*/
+	bool Convert(const uint8_t* src, size_t srcStride, int width, int height, uint32_t pixelFormat, uint8_t* dst, size_t dstStride)
+	{
+		Frame f;
+		if (!f.Set(src, srcStride, width, height, pixelFormat, dst, dstStride)) return false;
+		if (method == DEMOSAIC_EDGE)
+		{
+			green.resize(static_cast<size_t>(width) * height);
+			f.green = green.data();
+			RunBands(height, [&](int y0, int y1) { GreenBand(f, y0, y1); });
+			RunBands(height, [&](int y0, int y1) { ChromaBand(f, y0, y1); });
+		}
+		else
+		{
+			RunBands(height, [&](int y0, int y1) { BilinearBand(f, y0, y1); });
+		}
+		return true;
+	}
+
+	/*
+	Reference converts a frame pixel by pixel with mirrored borders everywhere, on the calling thread. It is slow and only used to validate
+	the fast paths.
+	*/
+	static bool Reference(const uint8_t* src, size_t srcStride, int width, int height, uint32_t pixelFormat, uint8_t* dst, size_t dstStride, DemosaicMethod method)
+	{
+		Frame f;
+		if (!f.Set(src, srcStride, width, height, pixelFormat, dst, dstStride)) return false;
+		std::vector<uint8_t> greenPlane(static_cast<size_t>(width) * height);
+		f.green = greenPlane.data();
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				if (method == DEMOSAIC_EDGE) f.green[static_cast<size_t>(y) * width + x] = GreenPixel(f, x, y);
+				else BilinearPixel(f, x, y);
+			}
+		}
+		if (method == DEMOSAIC_EDGE)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					ChromaPixel(f, x, y);
+				}
+			}
+		}
+		return true;
+	}
+
+	// BestIsa returns the fastest instruction set supported by this processor
+	static DemosaicIsa BestIsa()
+	{
+		static const DemosaicIsa best = DetectIsa();
+		return best;
+	}
+
+	static const char* IsaName(DemosaicIsa isa)
+	{
+		return isa == DEMOSAIC_AVX2 ? "AVX2" : isa == DEMOSAIC_SSE41 ? "SSE4.1" : "scalar";
+	}
+
+	static const char* MethodName(DemosaicMethod method)
+	{
+		return method == DEMOSAIC_EDGE ? "edge-aware" : "bilinear";
+	}
+
+	DemosaicIsa Isa() const { return isa; }
+	unsigned Threads() const { return numThreads; }
+
+private:
+	static const int k_border = 2; // pixels at each edge that are converted with mirrored neighbours
+	static const int k_minBandRows = 32;
+
+	// Frame describes one conversion; cp of a row is the column parity of its non-green colour, which is red in rows of parity ry
+	struct Frame
+	{
+		const uint8_t* src = nullptr;
+		size_t srcStride = 0;
+		int width = 0;
+		int height = 0;
+		int rx = 0; // column of red in the 2 x 2 Bayer tile
+		int ry = 0; // row of red in the 2 x 2 Bayer tile
+		uint8_t* dst = nullptr;
+		size_t dstStride = 0;
+		uint8_t* green = nullptr; // interpolated green plane (DEMOSAIC_EDGE), width bytes per row
+
+		bool Set(const uint8_t* s, size_t sStride, int w, int h, uint32_t pixelFormat, uint8_t* d, size_t dStride)
+		{
+			switch (pixelFormat)
+			{
+			case RODI_PIXEL_BAYERRG8: rx = 0; ry = 0; break;
+			case RODI_PIXEL_BAYERGR8: rx = 1; ry = 0; break;
+			case RODI_PIXEL_BAYERGB8: rx = 0; ry = 1; break;
+			case RODI_PIXEL_BAYERBG8: rx = 1; ry = 1; break;
+			default: return false;
+			}
+			if (w < 4 || h < 4 || s == nullptr || d == nullptr) return false;
+			src = s;
+			srcStride = sStride;
+			width = w;
+			height = h;
+			dst = d;
+			dstStride = dStride;
+			return true;
+		}
+		bool RedRow(int y) const { return (y & 1) == ry; }
+		int ColourParity(int y) const { return RedRow(y) ? rx : 1 - rx; }
+		const uint8_t* Row(int y) const { return src + static_cast<size_t>(y) * srcStride; }
+		const uint8_t* GreenRow(int y) const { return green + static_cast<size_t>(y) * width; }
+		int Raw(int x, int y) const { return src[static_cast<size_t>(Mirror(y, height)) * srcStride + Mirror(x, width)]; }
+		int Green(int x, int y) const { return green[static_cast<size_t>(Mirror(y, height)) * width + Mirror(x, width)]; }
+		void Put(int x, int y, int c, int g, int o) const // c is the colour recorded in row y, o the other one
+		{
+			uint8_t* p = dst + static_cast<size_t>(y) * dstStride + 3 * x;
+			p[0] = static_cast<uint8_t>(RedRow(y) ? o : c);
+			p[1] = static_cast<uint8_t>(g);
+			p[2] = static_cast<uint8_t>(RedRow(y) ? c : o);
+		}
+	};
+
+	static int Mirror(int i, int n) { return i < 0 ? -i : i >= n ? 2 * n - 2 - i : i; }
+	static int Clamp(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+	static void BilinearPixel(const Frame& f, int x, int y)
+	{
+		const int centre = f.Raw(x, y);
+		const int left = f.Raw(x - 1, y), right = f.Raw(x + 1, y), top = f.Raw(x, y - 1), bottom = f.Raw(x, y + 1);
+		if ((x & 1) == f.ColourParity(y))
+		{
+			const int diagonal = f.Raw(x - 1, y - 1) + f.Raw(x + 1, y - 1) + f.Raw(x - 1, y + 1) + f.Raw(x + 1, y + 1);
+			f.Put(x, y, centre, (left + right + top + bottom + 2) >> 2, (diagonal + 2) >> 2);
+		}
+		else
+		{
+			f.Put(x, y, (left + right + 1) >> 1, centre, (top + bottom + 1) >> 1);
+		}
+	}
+
+	static uint8_t GreenPixel(const Frame& f, int x, int y)
+	{
+		const int centre = f.Raw(x, y);
+		if ((x & 1) != f.ColourParity(y)) return static_cast<uint8_t>(centre);
+		const int left = f.Raw(x - 1, y), right = f.Raw(x + 1, y), top = f.Raw(x, y - 1), bottom = f.Raw(x, y + 1);
+		const int lapH = 2 * centre - f.Raw(x - 2, y) - f.Raw(x + 2, y);
+		const int lapV = 2 * centre - f.Raw(x, y - 2) - f.Raw(x, y + 2);
+		const int gh4 = 2 * (left + right) + lapH;
+		const int gv4 = 2 * (top + bottom) + lapV;
+		const int dh = std::abs(left - right) + std::abs(lapH);
+		const int dv = std::abs(top - bottom) + std::abs(lapV);
+		const int g = dh < dv ? (gh4 + 2) >> 2 : dv < dh ? (gv4 + 2) >> 2 : (gh4 + gv4 + 4) >> 3;
+		return static_cast<uint8_t>(Clamp(g));
+	}
+
+	static void ChromaPixel(const Frame& f, int x, int y)
+	{
+		const int g = f.Green(x, y);
+		if ((x & 1) == f.ColourParity(y))
+		{
+			const int diagonal = f.Raw(x - 1, y - 1) - f.Green(x - 1, y - 1) + f.Raw(x + 1, y - 1) - f.Green(x + 1, y - 1)
+				+ f.Raw(x - 1, y + 1) - f.Green(x - 1, y + 1) + f.Raw(x + 1, y + 1) - f.Green(x + 1, y + 1);
+			f.Put(x, y, f.Raw(x, y), g, Clamp(g + ((diagonal + 2) >> 2)));
+		}
+		else
+		{
+			const int horizontal = f.Raw(x - 1, y) - f.Green(x - 1, y) + f.Raw(x + 1, y) - f.Green(x + 1, y);
+			const int vertical = f.Raw(x, y - 1) - f.Green(x, y - 1) + f.Raw(x, y + 1) - f.Green(x, y + 1);
+			f.Put(x, y, Clamp(g + ((horizontal + 1) >> 1)), g, Clamp(g + ((vertical + 1) >> 1)));
+		}
+	}
+
+	// RunBands splits the rows into bands and calls work(firstRow, endRow) for each, the first band on the calling thread
+	template <class Work>
+	void RunBands(int height, const Work& work)
+	{
+		int bands = static_cast<int>(numThreads);
+		if (bands > height / k_minBandRows) bands = height / k_minBandRows;
+		if (bands < 1) bands = 1;
+		std::vector<std::thread> threads;
+		for (int b = 1; b < bands; b++)
+		{
+			threads.push_back(std::thread(work, height * b / bands, height * (b + 1) / bands));
+		}
+		work(0, height / bands);
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+
+	// Interior reports whether row y has the neighbours the row kernels need; its pixels k_border .. width - k_border are done by them
+	static bool Interior(const Frame& f, int y) { return y >= k_border && y < f.height - k_border; }
+
+	void BilinearBand(const Frame& f, int y0, int y1) const
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			int x = 0;
+			if (Interior(f, y))
+			{
+				for (; x < k_border; x++) BilinearPixel(f, x, y);
+				const uint8_t* up = f.Row(y - 1);
+				const uint8_t* row = f.Row(y);
+				const uint8_t* dn = f.Row(y + 1);
+				uint8_t* out = f.dst + static_cast<size_t>(y) * f.dstStride;
+				const int end = f.width - k_border;
+				const int cp = f.ColourParity(y);
+#ifdef RODI_DEMOSAIC_X86
+				if (isa == DEMOSAIC_AVX2) x = DemosaicAvx2::BilinearRow(up, row, dn, out, x, end, cp, f.RedRow(y));
+				if (isa >= DEMOSAIC_SSE41) x = DemosaicSse41::BilinearRow(up, row, dn, out, x, end, cp, f.RedRow(y));
+#endif
+				for (; x < end; x++)
+				{
+					const int centre = row[x];
+					if ((x & 1) == cp)
+					{
+						f.Put(x, y, centre, (row[x - 1] + row[x + 1] + up[x] + dn[x] + 2) >> 2, (up[x - 1] + up[x + 1] + dn[x - 1] + dn[x + 1] + 2) >> 2);
+					}
+					else
+					{
+						f.Put(x, y, (row[x - 1] + row[x + 1] + 1) >> 1, centre, (up[x] + dn[x] + 1) >> 1);
+					}
+				}
+			}
+			for (; x < f.width; x++) BilinearPixel(f, x, y);
+		}
+	}
+
+	void GreenBand(const Frame& f, int y0, int y1) const
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			uint8_t* green = f.green + static_cast<size_t>(y) * f.width;
+			int x = 0;
+			if (Interior(f, y))
+			{
+				for (; x < k_border; x++) green[x] = GreenPixel(f, x, y);
+				const uint8_t* const rows[5] = { f.Row(y - 2), f.Row(y - 1), f.Row(y), f.Row(y + 1), f.Row(y + 2) };
+				const int end = f.width - k_border;
+				const int cp = f.ColourParity(y);
+#ifdef RODI_DEMOSAIC_X86
+				if (isa == DEMOSAIC_AVX2) x = DemosaicAvx2::GreenRow(rows, green, x, end, cp);
+				if (isa >= DEMOSAIC_SSE41) x = DemosaicSse41::GreenRow(rows, green, x, end, cp);
+#endif
+				for (; x < end; x++)
+				{
+					const int centre = rows[2][x];
+					if ((x & 1) != cp)
+					{
+						green[x] = static_cast<uint8_t>(centre);
+						continue;
+					}
+					const int lapH = 2 * centre - rows[2][x - 2] - rows[2][x + 2];
+					const int lapV = 2 * centre - rows[0][x] - rows[4][x];
+					const int gh4 = 2 * (rows[2][x - 1] + rows[2][x + 1]) + lapH;
+					const int gv4 = 2 * (rows[1][x] + rows[3][x]) + lapV;
+					const int dh = std::abs(rows[2][x - 1] - rows[2][x + 1]) + std::abs(lapH);
+					const int dv = std::abs(rows[1][x] - rows[3][x]) + std::abs(lapV);
+					green[x] = static_cast<uint8_t>(Clamp(dh < dv ? (gh4 + 2) >> 2 : dv < dh ? (gv4 + 2) >> 2 : (gh4 + gv4 + 4) >> 3));
+				}
+			}
+			for (; x < f.width; x++) green[x] = GreenPixel(f, x, y);
+		}
+	}
+
+	void ChromaBand(const Frame& f, int y0, int y1) const
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			int x = 0;
+			if (Interior(f, y))
+			{
+				for (; x < k_border; x++) ChromaPixel(f, x, y);
+				const uint8_t* const s[3] = { f.Row(y - 1), f.Row(y), f.Row(y + 1) };
+				const uint8_t* const g[3] = { f.GreenRow(y - 1), f.GreenRow(y), f.GreenRow(y + 1) };
+				uint8_t* out = f.dst + static_cast<size_t>(y) * f.dstStride;
+				const int end = f.width - k_border;
+				const int cp = f.ColourParity(y);
+#ifdef RODI_DEMOSAIC_X86
+				if (isa == DEMOSAIC_AVX2) x = DemosaicAvx2::ChromaRow(s, g, out, x, end, cp, f.RedRow(y));
+				if (isa >= DEMOSAIC_SSE41) x = DemosaicSse41::ChromaRow(s, g, out, x, end, cp, f.RedRow(y));
+#endif
+				for (; x < end; x++)
+				{
+					const int green = g[1][x];
+					if ((x & 1) == cp)
+					{
+						const int diagonal = s[0][x - 1] - g[0][x - 1] + s[0][x + 1] - g[0][x + 1] + s[2][x - 1] - g[2][x - 1] + s[2][x + 1] - g[2][x + 1];
+						f.Put(x, y, s[1][x], green, Clamp(green + ((diagonal + 2) >> 2)));
+					}
+					else
+					{
+						const int horizontal = s[1][x - 1] - g[1][x - 1] + s[1][x + 1] - g[1][x + 1];
+						const int vertical = s[0][x] - g[0][x] + s[2][x] - g[2][x];
+						f.Put(x, y, Clamp(green + ((horizontal + 1) >> 1)), green, Clamp(green + ((vertical + 1) >> 1)));
+					}
+				}
+			}
+			for (; x < f.width; x++) ChromaPixel(f, x, y);
+		}
+	}
+
+	static DemosaicIsa DetectIsa()
+	{
+#ifdef RODI_DEMOSAIC_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool sse41 = (info[2] & (1 << 19)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) // the operating system saves the AVX registers
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		const bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+		const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		if (avx2) return DEMOSAIC_AVX2;
+		if (sse41) return DEMOSAIC_SSE41;
+#endif
+		return DEMOSAIC_SCALAR;
+	}
+
+	DemosaicMethod method;
+	unsigned numThreads;
+	DemosaicIsa isa;
+	std::vector<uint8_t> green; // green plane of DEMOSAIC_EDGE, reused between frames
+};
@@ -0,0 +1,154 @@
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// DemosaicKernels.inl holds the vectorized row kernels of Demosaic.h. It is included once per instruction set, inside its own namespace,
+// with RODI_DEMOSAIC_LANES = 8 (SSE4.1, 8 pixels per step) or 16 (AVX2, 16 pixels per step). The pixels are widened to 16-bit lanes;
+// every formula is computed for all lanes and the result for the colour actually recorded at a pixel is picked with a parity mask.
+// The kernels use the rounding of the scalar reference exactly, so all instruction sets give identical images.
+//========================================================================================================================================
+
+#if RODI_DEMOSAIC_LANES == 16
+typedef __m256i V;
+static inline V Load(const uint8_t* p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+static inline V Set(short v) { return _mm256_set1_epi16(v); }
+static inline V Add(V a, V b) { return _mm256_add_epi16(a, b); }
+static inline V Sub(V a, V b) { return _mm256_sub_epi16(a, b); }
+static inline V Shr1(V a) { return _mm256_srai_epi16(a, 1); }
+static inline V Shr2(V a) { return _mm256_srai_epi16(a, 2); }
+static inline V Shr3(V a) { return _mm256_srai_epi16(a, 3); }
+static inline V Abs(V a) { return _mm256_abs_epi16(a); }
+static inline V Less(V a, V b) { return _mm256_cmpgt_epi16(b, a); }
+static inline V Blend(V a, V b, V mask) { return _mm256_blendv_epi8(a, b, mask); } // b where mask is set
+static inline V ParityMask(int parity) { return _mm256_set1_epi32(parity ? static_cast<int>(0xFFFF0000) : 0x0000FFFF); }
+static inline __m128i Pack(V a) { return _mm_packus_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)); } // saturates to 0..255
+static inline void Store(uint8_t* p, __m128i a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+#else
+typedef __m128i V;
+static inline V Load(const uint8_t* p) { return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+static inline V Set(short v) { return _mm_set1_epi16(v); }
+static inline V Add(V a, V b) { return _mm_add_epi16(a, b); }
+static inline V Sub(V a, V b) { return _mm_sub_epi16(a, b); }
+static inline V Shr1(V a) { return _mm_srai_epi16(a, 1); }
+static inline V Shr2(V a) { return _mm_srai_epi16(a, 2); }
+static inline V Shr3(V a) { return _mm_srai_epi16(a, 3); }
+static inline V Abs(V a) { return _mm_abs_epi16(a); }
+static inline V Less(V a, V b) { return _mm_cmplt_epi16(a, b); }
+static inline V Blend(V a, V b, V mask) { return _mm_blendv_epi8(a, b, mask); } // b where mask is set
+static inline V ParityMask(int parity) { return _mm_set1_epi32(parity ? static_cast<int>(0xFFFF0000) : 0x0000FFFF); }
+static inline __m128i Pack(V a) { return _mm_packus_epi16(a, a); } // saturates to 0..255, 8 pixels in the low half
+static inline void Store(uint8_t* p, __m128i a) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), a); }
+#endif
+static const int k_lanes = RODI_DEMOSAIC_LANES;
+
+// StoreBGR interleaves k_lanes pixels of the b, g and r planes into 3 * k_lanes bytes of BGR8
+static inline void StoreBGR(uint8_t* dst, __m128i b, __m128i g, __m128i r)
+{
+	const __m128i b0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i r0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i b1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i r1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	__m128i* out = reinterpret_cast<__m128i*>(dst);
+	_mm_storeu_si128(out, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(r, r0)));
+	const __m128i mid = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(r, r1));
+	if (k_lanes == 8)
+	{
+		_mm_storel_epi64(out + 1, mid); // 24 bytes
+		return;
+	}
+	const __m128i b2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i r2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+	_mm_storeu_si128(out + 1, mid);
+	_mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(r, r2)));
+}
+
+/*
+BilinearRow demosaics the pixels x .. end - 1 of a row (bilinear), in steps of k_lanes, and returns the first pixel not done. up, row and
+dn are the raw rows y - 1, y and y + 1, cp is the column parity of the non-green colour of the row and cIsR tells whether that is red.
+*/
+static int BilinearRow(const uint8_t* up, const uint8_t* row, const uint8_t* dn, uint8_t* dst, int x, int end, int cp, bool cIsR)
+{
+	const V mask = ParityMask(cp);
+	const V one = Set(1);
+	const V two = Set(2);
+	for (; x + k_lanes <= end; x += k_lanes)
+	{
+		const V centre = Load(row + x);
+		const V left = Load(row + x - 1);
+		const V right = Load(row + x + 1);
+		const V top = Load(up + x);
+		const V bottom = Load(dn + x);
+		const V cross = Shr2(Add(Add(Add(left, right), Add(top, bottom)), two));
+		const V diagonal = Shr2(Add(Add(Add(Load(up + x - 1), Load(up + x + 1)), Add(Load(dn + x - 1), Load(dn + x + 1))), two));
+		const V horizontal = Shr1(Add(Add(left, right), one));
+		const V vertical = Shr1(Add(Add(top, bottom), one));
+		const __m128i c = Pack(Blend(horizontal, centre, mask));
+		const __m128i g = Pack(Blend(centre, cross, mask));
+		const __m128i o = Pack(Blend(vertical, diagonal, mask));
+		StoreBGR(dst + 3 * x, cIsR ? o : c, g, cIsR ? c : o);
+	}
+	return x;
+}
+
+/*
+GreenRow interpolates the green plane of the pixels x .. end - 1 of a row (edge-aware), in steps of k_lanes, and returns the first pixel
+not done. rows holds the raw rows y - 2 .. y + 2.
+*/
+static int GreenRow(const uint8_t* const rows[5], uint8_t* green, int x, int end, int cp)
+{
+	const V mask = ParityMask(cp);
+	const V two = Set(2);
+	const V four = Set(4);
+	for (; x + k_lanes <= end; x += k_lanes)
+	{
+		const V centre = Load(rows[2] + x);
+		const V centre2 = Add(centre, centre);
+		const V left = Load(rows[2] + x - 1);
+		const V right = Load(rows[2] + x + 1);
+		const V top = Load(rows[1] + x);
+		const V bottom = Load(rows[3] + x);
+		const V lapH = Sub(Sub(centre2, Load(rows[2] + x - 2)), Load(rows[2] + x + 2));
+		const V lapV = Sub(Sub(centre2, Load(rows[0] + x)), Load(rows[4] + x));
+		const V sumH = Add(left, right);
+		const V sumV = Add(top, bottom);
+		const V gh4 = Add(Add(sumH, sumH), lapH);
+		const V gv4 = Add(Add(sumV, sumV), lapV);
+		const V dh = Add(Abs(Sub(left, right)), Abs(lapH));
+		const V dv = Add(Abs(Sub(top, bottom)), Abs(lapV));
+		V g = Shr3(Add(Add(gh4, gv4), four));
+		g = Blend(g, Shr2(Add(gh4, two)), Less(dh, dv));
+		g = Blend(g, Shr2(Add(gv4, two)), Less(dv, dh));
+		__m128i packed = Pack(Blend(centre, g, mask));
+		Store(green + x, packed);
+	}
+	return x;
+}
+
+/*
+ChromaRow completes the pixels x .. end - 1 of a row from the raw rows s and the green rows g (y - 1 .. y + 1) by interpolating the
+colour differences, in steps of k_lanes, and returns the first pixel not done.
+*/
+static int ChromaRow(const uint8_t* const s[3], const uint8_t* const g[3], uint8_t* dst, int x, int end, int cp, bool cIsR)
+{
+	const V mask = ParityMask(cp);
+	const V one = Set(1);
+	const V two = Set(2);
+	for (; x + k_lanes <= end; x += k_lanes)
+	{
+		const V green = Load(g[1] + x);
+		const V left = Sub(Load(s[1] + x - 1), Load(g[1] + x - 1));
+		const V right = Sub(Load(s[1] + x + 1), Load(g[1] + x + 1));
+		const V top = Sub(Load(s[0] + x), Load(g[0] + x));
+		const V bottom = Sub(Load(s[2] + x), Load(g[2] + x));
+		const V diagonal = Add(Add(Sub(Load(s[0] + x - 1), Load(g[0] + x - 1)), Sub(Load(s[0] + x + 1), Load(g[0] + x + 1))),
+			Add(Sub(Load(s[2] + x - 1), Load(g[2] + x - 1)), Sub(Load(s[2] + x + 1), Load(g[2] + x + 1))));
+		const V horizontal = Add(green, Shr1(Add(Add(left, right), one)));
+		const V vertical = Add(green, Shr1(Add(Add(top, bottom), one)));
+		const V diagonal4 = Add(green, Shr2(Add(diagonal, two)));
+		const __m128i c = Pack(Blend(horizontal, Load(s[1] + x), mask));
+		const __m128i o = Pack(Blend(vertical, diagonal4, mask));
+		StoreBGR(dst + 3 * x, cIsR ? o : c, Pack(green), cIsR ? c : o);
+	}
+	return x;
+}
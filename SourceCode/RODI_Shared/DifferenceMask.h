@@ -0,0 +1,157 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// DifferenceMask binarizes the difference of a frame and its background in one pass: the mask is 255 where the 3x3 mean of the absolute
+// difference exceeds a threshold and 0 elsewhere. It gives exactly the image of the OpenCV sequence
+//
+//	absdiff(background, image, diff); blur(diff, diffblur, Size(3, 3), Point(-1, -1), border); threshold(diffblur, mask, t, 255, THRESH_BINARY)
+//
+// with border BORDER_CONSTANT (zeros) or BORDER_REFLECT_101 (mirrored): blur rounds the sum s of nine pixels to the nearest integer of
+// s / 9, which is above t exactly when s > 9 t + 4. The frame is processed row by row; the differences and the horizontal sums of the last
+// three rows stay in small row buffers, so every pixel of the frame and the background is read once and the mask written once, without the
+// two full-size intermediate images. The rows run on AVX2 or SSE4.1 kernels (DifferenceMaskKernels.inl) as chosen by Demosaic::BestIsa,
+// with a scalar fallback. RODI_BoundB --validate-detection checks every instruction set against the OpenCV sequence.
+//========================================================================================================================================
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include "Demosaic.h"
+
+#ifdef RODI_DEMOSAIC_X86
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+namespace DifferenceMaskSse41
+{
+#define RODI_MASK_LANES 8
+#include "DifferenceMaskKernels.inl"
+#undef RODI_MASK_LANES
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace DifferenceMaskAvx2
+{
+#define RODI_MASK_LANES 16
+#include "DifferenceMaskKernels.inl"
+#undef RODI_MASK_LANES
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif
+
+class DifferenceMask
+{
+public:
+	// isa defaults to the best instruction set of this processor and is lowered to what the processor supports
+	explicit DifferenceMask(DemosaicIsa maskIsa = Demosaic::BestIsa()) : isa(maskIsa < Demosaic::BestIsa() ? maskIsa : Demosaic::BestIsa()) {}
+
+	/*
+	Compute writes the mask of the width x height image and background (rows imageStride and backgroundStride bytes apart) to mask (rows
+	maskStride bytes apart), mirrored selects BORDER_REFLECT_101 instead of BORDER_CONSTANT. mask must not overlap the inputs.
+	*/
+	void Compute(const uint8_t* image, size_t imageStride, const uint8_t* background, size_t backgroundStride, int width, int height, int threshold,
+		uint8_t* mask, size_t maskStride, bool mirrored = false)
+	{
+		if (width < 1 || height < 1) return;
+		const int sumThreshold = 9 * threshold + 4;
+		diff.resize(static_cast<size_t>(width) + 2);
+		for (int i = 0; i < 3; i++)
+		{
+			sums[i].resize(width);
+		}
+		// the horizontal sums of rows y - 1, y and y + 1 are in sums[(y + 2) % 3], sums[y % 3] and sums[(y + 1) % 3] (rows -1 and height: border)
+		SumRow(image, imageStride, background, backgroundStride, width, height, -1, mirrored, sums[2].data());
+		SumRow(image, imageStride, background, backgroundStride, width, height, 0, mirrored, sums[0].data());
+		for (int y = 0; y < height; y++)
+		{
+			SumRow(image, imageStride, background, backgroundStride, width, height, y + 1, mirrored, sums[(y + 1) % 3].data());
+			const int16_t* up = sums[(y + 2) % 3].data();
+			const int16_t* row = sums[y % 3].data();
+			const int16_t* down = sums[(y + 1) % 3].data();
+			uint8_t* out = mask + static_cast<size_t>(y) * maskStride;
+			int x = 0;
+#ifdef RODI_DEMOSAIC_X86
+			if (isa == DEMOSAIC_AVX2) x = DifferenceMaskAvx2::MaskRow(up, row, down, out, x, width, sumThreshold);
+			if (isa >= DEMOSAIC_SSE41) x = DifferenceMaskSse41::MaskRow(up, row, down, out, x, width, sumThreshold);
+#endif
+			for (; x < width; x++)
+			{
+				out[x] = up[x] + row[x] + down[x] > sumThreshold ? 255 : 0;
+			}
+		}
+	}
+
+	DemosaicIsa Isa() const { return isa; }
+
+private:
+	DifferenceMask(const DifferenceMask&) = delete;
+	DifferenceMask& operator=(const DifferenceMask&) = delete;
+
+	// Border returns the row or column read for i in 0 .. n - 1 and its neighbours just outside, -1 for a zero (constant) border
+	static int Border(int i, int n, bool mirrored)
+	{
+		if (i >= 0 && i < n) return i;
+		if (!mirrored) return -1;
+		if (n == 1) return 0;
+		return i < 0 ? -i : 2 * n - 2 - i;
+	}
+
+	// SumRow sets out to the horizontal 3-pixel sums of the absolute difference of row y
+	void SumRow(const uint8_t* image, size_t imageStride, const uint8_t* background, size_t backgroundStride, int width, int height, int y, bool mirrored, int16_t* out)
+	{
+		const int source = Border(y, height, mirrored);
+		if (source < 0)
+		{
+			std::fill(out, out + width, static_cast<int16_t>(0));
+			return;
+		}
+		const uint8_t* a = image + static_cast<size_t>(source) * imageStride;
+		const uint8_t* b = background + static_cast<size_t>(source) * backgroundStride;
+		uint8_t* d = diff.data() + 1; // d[-1] and d[width] are the border columns
+		int x = 0;
+#ifdef RODI_DEMOSAIC_X86
+		if (isa == DEMOSAIC_AVX2) x = DifferenceMaskAvx2::AbsDiffRow(a, b, d, x, width);
+		if (isa >= DEMOSAIC_SSE41) x = DifferenceMaskSse41::AbsDiffRow(a, b, d, x, width);
+#endif
+		for (; x < width; x++)
+		{
+			d[x] = static_cast<uint8_t>(std::abs(a[x] - b[x]));
+		}
+		const int left = Border(-1, width, mirrored);
+		const int right = Border(width, width, mirrored);
+		d[-1] = left < 0 ? 0 : d[left];
+		d[width] = right < 0 ? 0 : d[right];
+		x = 0;
+#ifdef RODI_DEMOSAIC_X86
+		if (isa == DEMOSAIC_AVX2) x = DifferenceMaskAvx2::SumRow(diff.data(), out, x, width);
+		if (isa >= DEMOSAIC_SSE41) x = DifferenceMaskSse41::SumRow(diff.data(), out, x, width);
+#endif
+		for (; x < width; x++)
+		{
+			out[x] = static_cast<int16_t>(d[x - 1] + d[x] + d[x + 1]);
+		}
+	}
+
+	DemosaicIsa isa;
+	std::vector<uint8_t> diff; // absolute difference of one row with a border column at each end
+	std::vector<int16_t> sums[3]; // horizontal sums of three rows
+};
@@ -0,0 +1,67 @@
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// DifferenceMaskKernels.inl holds the vectorized row kernels of DifferenceMask.h. It is included once per instruction set, inside its own
+// namespace, with RODI_MASK_LANES = 8 (SSE4.1) or 16 (AVX2): the absolute differences take 2 * RODI_MASK_LANES pixels per step, the sums
+// RODI_MASK_LANES pixels in 16-bit lanes. The sums of nine pixels fit 16 bits (at most 2295), so the kernels are exact.
+//========================================================================================================================================
+
+#if RODI_MASK_LANES == 16
+typedef __m256i V;
+static inline V LoadBytes(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static inline void StoreBytes(uint8_t* p, V a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+static inline V AbsDiff(V a, V b) { return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a)); }
+static inline V Widen(const uint8_t* p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+static inline V LoadSums(const int16_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static inline void StoreSums(int16_t* p, V a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+static inline V Add(V a, V b) { return _mm256_add_epi16(a, b); }
+static inline V Set(short v) { return _mm256_set1_epi16(v); }
+static inline V Greater(V a, V b) { return _mm256_cmpgt_epi16(a, b); }
+static inline void StoreMask(uint8_t* p, V a) // 0xFFFF / 0 lanes to 255 / 0 bytes
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packs_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+}
+#else
+typedef __m128i V;
+static inline V LoadBytes(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static inline void StoreBytes(uint8_t* p, V a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+static inline V AbsDiff(V a, V b) { return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); }
+static inline V Widen(const uint8_t* p) { return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+static inline V LoadSums(const int16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static inline void StoreSums(int16_t* p, V a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+static inline V Add(V a, V b) { return _mm_add_epi16(a, b); }
+static inline V Set(short v) { return _mm_set1_epi16(v); }
+static inline V Greater(V a, V b) { return _mm_cmpgt_epi16(a, b); }
+static inline void StoreMask(uint8_t* p, V a) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi16(a, a)); }
+#endif
+static const int k_lanes = RODI_MASK_LANES;
+
+// AbsDiffRow sets diff[x] = |image[x] - background[x]| from x on and returns where the scalar code continues
+static inline int AbsDiffRow(const uint8_t* image, const uint8_t* background, uint8_t* diff, int x, int end)
+{
+	for (; x + 2 * k_lanes <= end; x += 2 * k_lanes)
+	{
+		StoreBytes(diff + x, AbsDiff(LoadBytes(image + x), LoadBytes(background + x)));
+	}
+	return x;
+}
+
+// SumRow sets sums[x] = diff[x] + diff[x + 1] + diff[x + 2] (diff has one border pixel in front) from x on
+static inline int SumRow(const uint8_t* diff, int16_t* sums, int x, int end)
+{
+	for (; x + k_lanes <= end; x += k_lanes)
+	{
+		StoreSums(sums + x, Add(Add(Widen(diff + x), Widen(diff + x + 1)), Widen(diff + x + 2)));
+	}
+	return x;
+}
+
+// MaskRow sets mask[x] to 255 where the sums of three rows exceed sumThreshold, 0 elsewhere, from x on
+static inline int MaskRow(const int16_t* up, const int16_t* row, const int16_t* down, uint8_t* mask, int x, int end, int sumThreshold)
+{
+	const V limit = Set(static_cast<short>(sumThreshold));
+	for (; x + k_lanes <= end; x += k_lanes)
+	{
+		StoreMask(mask + x, Greater(Add(Add(LoadSums(up + x), LoadSums(row + x)), LoadSums(down + x)), limit));
+	}
+	return x;
+}
@@ -0,0 +1,165 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// FolderWatcher follows a folder that RODI_REC is recording into and hands out every .tmp file once it is complete, so RODI_CONV and
+// RODI_BoundB can process the recording while it runs. A file is complete when RODI_REC has finalized it (RodiFileFinalized: seek table
+// and footer written, preallocation truncated). A file that never gets a footer (interrupted recording) is handed out once its size and
+// modification time have not changed for settleSeconds and it opens as a RODI file with at least one frame; a segment RODI_REC has
+// opened ahead but not written to yet holds only its header, and headerless legacy files are not followed. Wait sleeps until the folder
+// changes: inotify on Linux, a change notification on Windows, and plain polling at the timeout where neither is available. A file that
+// changes after it was handed out (a recording finalized after it settled) is handed out again.
+//========================================================================================================================================
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <boost/filesystem.hpp>
+#include "RodiRawFormat.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+class FolderWatcher
+{
+public:
+	FolderWatcher() : settleSeconds(300), notification(k_noNotification) {}
+	~FolderWatcher() { Close(); }
+
+	// Open starts watching folder for .tmp files. Returns false if the folder does not exist.
+	bool Open(const std::string& watchFolder, int settle)
+	{
+		Close();
+		boost::system::error_code ec;
+		if (!boost::filesystem::is_directory(watchFolder, ec)) return false;
+		folder = watchFolder;
+		settleSeconds = settle;
+#ifdef _WIN32
+		HANDLE h = FindFirstChangeNotificationA(folder.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		if (h != INVALID_HANDLE_VALUE) notification = h;
+#elif defined(__linux__)
+		const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd >= 0 && inotify_add_watch(fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY) >= 0) notification = fd;
+		else if (fd >= 0) close(fd);
+#endif
+		return true;
+	}
+
+	void Close()
+	{
+		if (notification == k_noNotification) return;
+#ifdef _WIN32
+		FindCloseChangeNotification(notification);
+#elif defined(__linux__)
+		close(notification);
+#endif
+		notification = k_noNotification;
+	}
+
+	// Notified tells whether Wait is woken by changes in the folder (inotify, change notification) or only polls
+	bool Notified() const { return notification != k_noNotification; }
+
+	// Wait returns when the folder has changed or after timeoutMs milliseconds
+	void Wait(int timeoutMs)
+	{
+#ifdef _WIN32
+		if (notification != k_noNotification)
+		{
+			if (WaitForSingleObject(notification, static_cast<DWORD>(timeoutMs)) == WAIT_OBJECT_0) FindNextChangeNotification(notification);
+			return;
+		}
+#elif defined(__linux__)
+		if (notification != k_noNotification)
+		{
+			struct pollfd p = { notification, POLLIN, 0 };
+			if (poll(&p, 1, timeoutMs) > 0)
+			{
+				char events[4096];
+				while (read(notification, events, sizeof(events)) > 0) {} // drain, the folder is listed again anyway
+			}
+			return;
+		}
+#endif
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+	}
+
+	// ReadyFiles returns the .tmp files that have become complete since the last call, in name order
+	std::vector<std::string> ReadyFiles()
+	{
+		std::vector<std::string> ready;
+		std::map<std::string, FileState> current;
+		const std::time_t now = std::time(nullptr);
+		boost::system::error_code ec;
+		for (boost::filesystem::directory_iterator i(folder, ec), end; !ec && i != end; i.increment(ec))
+		{
+			if (i->path().extension() != ".tmp" || boost::filesystem::is_directory(i->path(), ec)) continue;
+			const std::string path = i->path().string();
+			FileState state;
+			state.size = boost::filesystem::file_size(path, ec);
+			if (ec) continue;
+			state.mtime = boost::filesystem::last_write_time(path, ec);
+			if (ec) continue;
+			state.seen = now;
+			std::map<std::string, FileState>::const_iterator last = files.find(path);
+			const bool unchanged = last != files.end() && last->second.size == state.size && last->second.mtime == state.mtime;
+			if (unchanged)
+			{
+				state.seen = last->second.seen;
+				state.handedOut = last->second.handedOut;
+			}
+			if (!state.handedOut && (RodiFileFinalized(path) || (unchanged && now - state.seen >= settleSeconds && HoldsFrames(path))))
+			{
+				state.handedOut = true;
+				ready.push_back(path);
+			}
+			current[path] = state;
+		}
+		files.swap(current); // deleted files are forgotten
+		std::sort(ready.begin(), ready.end()); // directory order is not sorted on every filesystem
+		return ready;
+	}
+
+	std::string Folder() const { return folder; }
+
+private:
+#ifdef _WIN32
+	typedef HANDLE Notification;
+	static constexpr HANDLE k_noNotification = nullptr;
+#else
+	typedef int Notification;
+	static const int k_noNotification = -1;
+#endif
+
+	FolderWatcher(const FolderWatcher&) = delete;
+	FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+	// HoldsFrames tells whether the file at path opens as a RODI file (not a headerless one) with at least one complete frame
+	static bool HoldsFrames(const std::string& path)
+	{
+		RodiRawReader reader;
+		return reader.Open(path, 0, 0) && !reader.IsLegacy();
+	}
+
+	struct FileState
+	{
+		uintmax_t size = 0;
+		std::time_t mtime = 0;
+		std::time_t seen = 0; // when size and mtime were first seen as they are now
+		bool handedOut = false;
+	};
+
+	std::string folder;
+	int settleSeconds;
+	Notification notification;
+	std::map<std::string, FileState> files; // .tmp files of the last listing, by path
+};
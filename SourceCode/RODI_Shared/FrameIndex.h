@@ -0,0 +1,115 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// Binary frame index written by RODI_REC next to every .tmp file (same name, .idx extension). The file starts with a FrameIndexHeader
+// followed by one fixed-size FrameIndexRecord per frame. Records are buffered and written in batches so the writer thread issues one
+// small write per k_indexBatch frames instead of one flushed CSV line per frame. The legacy .csv log can be regenerated from the index
+// with "RODI_REC --export-csv <folder>". With the motion trigger on, frames that were not stored keep their record (flag
+// k_rodiFrameDiscarded), so the index still holds the timestamp of every grabbed frame; "--export-csv <folder> --stored" adds a Stored
+// column to the .csv log.
+//========================================================================================================================================
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1)
+struct FrameIndexHeader
+{
+	char magic[8]; // "RODIIDX1"
+	uint32_t version; // k_indexVersion
+	uint32_t recordSize; // sizeof(FrameIndexRecord)
+	char serialNumber[32]; // camera serial number, zero terminated
+	uint32_t fileNumber; // number of the .tmp file this index belongs to
+	uint32_t totalfiles; // totalfiles of the recording (used to format file numbers), 0 if the files were rotated by size or duration
+};
+
+struct FrameIndexRecord
+{
+	uint64_t frameID; // camera FrameID
+	uint64_t timestamp; // camera timestamp in nanoseconds
+	int64_t hostTimestamp; // system time in nanoseconds when the frame was grabbed (TimeStamp() in RODI_REC)
+	uint32_t fileNumber; // .tmp file the frame was written to
+	uint32_t flags; // RodiFrameHeader flags of the frame (k_rodiFrame*)
+	uint64_t byteOffset; // offset of the frame record (RodiFrameHeader) in the .tmp file, 0 for discarded frames
+};
+#pragma pack(pop)
+
+static const char k_indexMagic[8] = { 'R', 'O', 'D', 'I', 'I', 'D', 'X', '1' };
+static const uint32_t k_indexVersion = 1;
+static const size_t k_indexBatch = 256; // records buffered before they are written
+
+class FrameIndexWriter
+{
+public:
+	FrameIndexWriter() : file(nullptr) { records.reserve(k_indexBatch); }
+	~FrameIndexWriter() { Close(); }
+
+	bool Open(const std::string& path, const std::string& serialNumber, uint32_t fileNumber, uint32_t totalfiles)
+	{
+		Close();
+		file = fopen(path.c_str(), "wb");
+		if (file == nullptr) return false;
+		FrameIndexHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, k_indexMagic, sizeof(header.magic));
+		header.version = k_indexVersion;
+		header.recordSize = sizeof(FrameIndexRecord);
+		strncpy(header.serialNumber, serialNumber.c_str(), sizeof(header.serialNumber) - 1);
+		header.fileNumber = fileNumber;
+		header.totalfiles = totalfiles;
+		return fwrite(&header, sizeof(header), 1, file) == 1;
+	}
+
+	bool Append(const FrameIndexRecord& record)
+	{
+		records.push_back(record);
+		return records.size() < k_indexBatch || Flush();
+	}
+
+	bool Flush()
+	{
+		if (file == nullptr) return false;
+		bool ok = records.empty() || fwrite(records.data(), sizeof(FrameIndexRecord), records.size(), file) == records.size();
+		records.clear();
+		return ok;
+	}
+
+	bool Close()
+	{
+		if (file == nullptr) return true;
+		bool ok = Flush();
+		ok = fclose(file) == 0 && ok;
+		file = nullptr;
+		return ok;
+	}
+
+private:
+	FrameIndexWriter(const FrameIndexWriter&) = delete;
+	FrameIndexWriter& operator=(const FrameIndexWriter&) = delete;
+
+	FILE* file;
+	std::vector<FrameIndexRecord> records; // records waiting for the next batch write
+};
+
+// ReadFrameIndex loads a complete .idx file. Returns false if the file is missing or not a RODI frame index.
+inline bool ReadFrameIndex(const std::string& path, FrameIndexHeader& header, std::vector<FrameIndexRecord>& records)
+{
+	records.clear();
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr) return false;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, k_indexMagic, sizeof(header.magic)) == 0
+		&& header.recordSize == sizeof(FrameIndexRecord);
+	if (ok)
+	{
+		FrameIndexRecord record;
+		while (fread(&record, sizeof(record), 1, file) == 1)
+		{
+			records.push_back(record);
+		}
+	}
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,288 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// Manifest keeps track of the work a post-processing tool (RODI_CONV, RODI_BoundB) has done in its output folder, so a batch can be run
+// again and only does what is missing. It is a text file in the output folder (<tool>.manifest), one tab separated line per source file:
+//
+//   source  size  mtime  hash  parameters  status  progress  outputs
+//
+// source is the file name of the .tmp file. size, mtime and hash fingerprint its content; the hash covers the first and last
+// k_hashBytes of the file (file header, first frames, seek table), so it is computed in milliseconds even for 20 GB files. parameters
+// holds the tool settings that change the outputs. status is "partial" while a file is processed (progress frames done) and "done" when
+// it is complete; outputs lists the files written for it, separated by '|'. A file is skipped when its fingerprint, parameters and status
+// match and all outputs exist. The manifest is rewritten through a temporary file and a rename, so an interrupted run never leaves it
+// half written.
+//========================================================================================================================================
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <boost/filesystem.hpp>
+#include "RodiRawFormat.h"
+
+enum ManifestAction
+{
+	MANIFEST_PROCESS, // new, changed or failed source, different parameters or missing outputs: process from the start
+	MANIFEST_RESUME, // interrupted with the same source and parameters: continue at progress
+	MANIFEST_SKIP // up to date
+};
+
+struct ManifestEntry
+{
+	std::string source;
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+	std::string parameters;
+	std::string status; // partial, done or failed
+	uint64_t progress = 0; // frames done
+	std::vector<std::string> outputs;
+};
+
+class Manifest
+{
+public:
+	static const uint64_t k_hashBytes = 1024 * 1024; // bytes hashed at the start and at the end of a source file
+
+	// Load reads the manifest of tool in folder; a missing manifest is an empty one. Returns false if it exists but cannot be read.
+	bool Load(const std::string& folder, const std::string& tool)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		path = (boost::filesystem::path(folder) / (tool + ".manifest")).string();
+		outputFolder = folder;
+		boost::system::error_code ec;
+		if (!boost::filesystem::exists(path, ec)) return true;
+		std::ifstream file(path);
+		if (!file.is_open()) return false;
+		std::string line;
+		while (getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.empty() || line[0] == '#') continue;
+			std::vector<std::string> fields = Split(line, '\t');
+			if (fields.size() < 7) continue;
+			ManifestEntry entry;
+			entry.source = fields[0];
+			entry.size = std::stoull(fields[1]);
+			entry.mtime = std::stoll(fields[2]);
+			entry.hash = std::stoull(fields[3], nullptr, 16);
+			entry.parameters = fields[4];
+			entry.status = fields[5];
+			entry.progress = std::stoull(fields[6]);
+			if (fields.size() > 7 && !fields[7].empty()) entry.outputs = Split(fields[7], '|');
+			entries[entry.source] = entry;
+		}
+		return true;
+	}
+
+	// Fingerprint fills the source, size, mtime and hash of entry for the file at sourcePath. Returns false if it cannot be read.
+	static bool Fingerprint(const std::string& sourcePath, ManifestEntry& entry)
+	{
+		boost::system::error_code ec;
+		entry.source = boost::filesystem::path(sourcePath).filename().string();
+		entry.size = boost::filesystem::file_size(sourcePath, ec);
+		if (ec) return false;
+		entry.mtime = static_cast<int64_t>(boost::filesystem::last_write_time(sourcePath, ec));
+		if (ec) return false;
+		FILE* file = fopen(sourcePath.c_str(), "rb");
+		if (file == nullptr) return false;
+		std::vector<char> buffer(static_cast<size_t>(entry.size < 2 * k_hashBytes ? entry.size : k_hashBytes));
+		uint64_t hash = 14695981039346656037ull; // FNV-1a
+		bool ok = true;
+		for (int part = 0; part < (entry.size > buffer.size() ? 2 : 1) && ok; part++)
+		{
+			if (part == 1) ok = RodiSeek(file, entry.size - buffer.size()) == 0;
+			ok = ok && fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+			for (size_t i = 0; ok && i < buffer.size(); i++)
+			{
+				hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+			}
+		}
+		fclose(file);
+		entry.hash = hash;
+		return ok;
+	}
+
+	/*
+	Check decides what to do with the file at sourcePath under parameters and returns its new entry in current (fingerprint and parameters,
+	with the progress and outputs of an interrupted run for MANIFEST_RESUME). reason says why it is not skipped.
+	*/
+	ManifestAction Check(const std::string& sourcePath, const std::string& parameters, ManifestEntry& current, std::string& reason)
+	{
+		current = ManifestEntry();
+		current.parameters = parameters;
+		if (!Fingerprint(sourcePath, current))
+		{
+			reason = "source cannot be read";
+			return MANIFEST_PROCESS;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, ManifestEntry>::const_iterator it = entries.find(current.source);
+		if (it == entries.end())
+		{
+			reason = "new";
+			return MANIFEST_PROCESS;
+		}
+		const ManifestEntry& done = it->second;
+		if (done.size != current.size || done.mtime != current.mtime || done.hash != current.hash) reason = "source changed";
+		else if (done.parameters != parameters) reason = "parameters changed";
+		else if (done.status == "failed") reason = "failed before";
+		else if (done.status == "partial")
+		{
+			current.progress = done.progress;
+			current.outputs = done.outputs;
+			reason = "interrupted after " + std::to_string(done.progress) + " frames";
+			return done.progress > 0 ? MANIFEST_RESUME : MANIFEST_PROCESS;
+		}
+		else
+		{
+			for (size_t i = 0; i < done.outputs.size(); i++)
+			{
+				boost::system::error_code ec;
+				if (!boost::filesystem::exists(boost::filesystem::path(outputFolder) / done.outputs[i], ec))
+				{
+					reason = "output " + done.outputs[i] + " missing";
+					return MANIFEST_PROCESS;
+				}
+			}
+			return MANIFEST_SKIP;
+		}
+		return MANIFEST_PROCESS;
+	}
+
+	/*
+	Begin records that current is being processed. Unless the run is resumed, the outputs of an earlier run of the source are deleted first,
+	so outputs that the new parameters do not produce (another container, fewer rollover files) do not linger.
+	*/
+	bool Begin(ManifestEntry current, bool resume)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, ManifestEntry>::const_iterator it = entries.find(current.source);
+		if (!resume)
+		{
+			if (it != entries.end()) RemoveOutputs(it->second.outputs);
+			current.progress = 0;
+			current.outputs.clear();
+		}
+		current.status = "partial";
+		entries[current.source] = current;
+		return Save();
+	}
+
+	// Progress records that frames frames of source are done and adds the outputs written since the last call
+	bool Progress(const std::string& source, uint64_t frames, const std::vector<std::string>& newOutputs)
+	{
+		return Update(source, "partial", frames, newOutputs);
+	}
+
+	// Finish records that source is complete with frames frames and adds the last outputs
+	bool Finish(const std::string& source, uint64_t frames, const std::vector<std::string>& newOutputs)
+	{
+		return Update(source, "done", frames, newOutputs);
+	}
+
+	// Fail records that source failed, with the outputs it left behind; it is processed from the start by the next run
+	bool Fail(const std::string& source, const std::vector<std::string>& newOutputs)
+	{
+		return Update(source, "failed", 0, newOutputs);
+	}
+
+	/*
+	FindOutputs returns the names of the files in folder that belong to stem: stem followed by an extension (stem.avi) or a file number
+	(stem-0001.avi, as written by SpinVideo and FfmpegVideo when maxVideoSize is reached).
+	*/
+	static std::vector<std::string> FindOutputs(const std::string& folder, const std::string& stem)
+	{
+		std::vector<std::string> outputs;
+		boost::system::error_code ec;
+		for (boost::filesystem::directory_iterator i(folder, ec), end; !ec && i != end; i.increment(ec))
+		{
+			const std::string name = i->path().filename().string();
+			if (name.size() > stem.size() && name.compare(0, stem.size(), stem) == 0 && (name[stem.size()] == '.' || name[stem.size()] == '-')
+				&& name.find(".manifest") == std::string::npos)
+			{
+				outputs.push_back(name);
+			}
+		}
+		return outputs;
+	}
+
+	std::string Path() const { return path; }
+
+private:
+	static std::vector<std::string> Split(const std::string& line, char separator)
+	{
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		std::string field;
+		while (getline(ss, field, separator))
+		{
+			fields.push_back(field);
+		}
+		if (!line.empty() && line.back() == separator) fields.push_back("");
+		return fields;
+	}
+
+	bool Update(const std::string& source, const std::string& status, uint64_t frames, const std::vector<std::string>& newOutputs)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, ManifestEntry>::iterator it = entries.find(source);
+		if (it == entries.end()) return false;
+		it->second.status = status;
+		if (status != "failed") it->second.progress = frames;
+		for (size_t i = 0; i < newOutputs.size(); i++)
+		{
+			if (std::find(it->second.outputs.begin(), it->second.outputs.end(), newOutputs[i]) == it->second.outputs.end()) it->second.outputs.push_back(newOutputs[i]);
+		}
+		return Save();
+	}
+
+	void RemoveOutputs(const std::vector<std::string>& outputs)
+	{
+		for (size_t i = 0; i < outputs.size(); i++)
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove(boost::filesystem::path(outputFolder) / outputs[i], ec);
+		}
+	}
+
+	// Save writes all entries to a temporary file and renames it over the manifest
+	bool Save()
+	{
+		const std::string temporary = path + ".part";
+		{
+			std::ofstream file(temporary, std::ios::trunc);
+			if (!file.is_open()) return false;
+			file << "# source\tsize\tmtime\thash\tparameters\tstatus\tprogress\toutputs" << std::endl;
+			for (std::map<std::string, ManifestEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				const ManifestEntry& e = it->second;
+				file << e.source << '\t' << e.size << '\t' << e.mtime << '\t' << std::hex << e.hash << std::dec << '\t' << e.parameters << '\t'
+					<< e.status << '\t' << e.progress << '\t';
+				for (size_t i = 0; i < e.outputs.size(); i++)
+				{
+					file << (i > 0 ? "|" : "") << e.outputs[i];
+				}
+				file << '\n';
+			}
+			file.flush();
+			if (!file.good()) return false;
+		}
+		boost::system::error_code ec;
+		boost::filesystem::rename(temporary, path, ec);
+		return !ec;
+	}
+
+	std::mutex mutex;
+	std::map<std::string, ManifestEntry> entries; // by source file name
+	std::string path;
+	std::string outputFolder;
+};
@@ -0,0 +1,179 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// MappedFile gives read-only, memory-mapped access to a large file (the .tmp files of RODI_REC) through a sliding window. Only the window
+// around the bytes last asked for is mapped (k_windowBytes, aligned to the allocation granularity), so a 20 GB file never occupies more
+// than a few windows of address space. The file and every window are mapped with sequential-access hints (FILE_FLAG_SEQUENTIAL_SCAN and
+// PrefetchVirtualMemory on Windows, MADV_SEQUENTIAL on Linux). When a window is released its pages are dropped from the page cache on
+// Linux (POSIX_FADV_DONTNEED); on Windows unmapped pages move to the standby list and are reused first.
+//
+// View returns a pointer into the current window. A caller that holds on to the data (a frame queued for the encoder) also takes the
+// keepAlive reference: the window stays mapped until the last reference is released, even after the reader has moved on.
+//========================================================================================================================================
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+class MappedFile
+{
+public:
+	static const uint64_t k_windowBytes = 64ull * 1024 * 1024; // bytes mapped at a time (more if a single view is larger)
+
+	MappedFile() : fileSize(0), granularity(AllocationGranularity()), windowsMapped(0) {}
+	~MappedFile() { Close(); }
+
+	// Open opens path for mapping. Returns false if the file cannot be opened or is empty.
+	bool Open(const std::string& path)
+	{
+		Close();
+		std::shared_ptr<Handle> h = std::make_shared<Handle>();
+#ifdef _WIN32
+		h->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (h->file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(h->file, &size) || size.QuadPart == 0) return false;
+		fileSize = static_cast<uint64_t>(size.QuadPart);
+		h->mapping = CreateFileMappingA(h->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (h->mapping == nullptr) return false;
+#else
+		h->fd = open(path.c_str(), O_RDONLY);
+		if (h->fd < 0) return false;
+		struct stat st;
+		if (fstat(h->fd, &st) != 0 || st.st_size == 0) return false;
+		fileSize = static_cast<uint64_t>(st.st_size);
+		posix_fadvise(h->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		handle = h;
+		return true;
+	}
+
+	// Close releases the current window. Windows still referenced by callers stay mapped until they are released.
+	void Close()
+	{
+		window.reset();
+		handle.reset();
+		fileSize = 0;
+		windowsMapped = 0;
+	}
+
+	/*
+	View returns a pointer to length bytes at offset, mapping a new window if they are outside the current one, or nullptr if the bytes
+	are not in the file or cannot be mapped. The pointer stays valid until the next call, or as long as keepAlive is held.
+	*/
+	const char* View(uint64_t offset, size_t length, std::shared_ptr<const void>* keepAlive = nullptr)
+	{
+		if (!handle || offset + length > fileSize) return nullptr;
+		if (!window || offset < window->offset || offset + length > window->offset + window->length)
+		{
+			window.reset(); // drop the old window first, so at most the windows held by callers and the new one are mapped
+			window = Map(offset, length);
+			if (!window) return nullptr;
+		}
+		if (keepAlive != nullptr) *keepAlive = window;
+		return window->base + (offset - window->offset);
+	}
+
+	bool IsOpen() const { return static_cast<bool>(handle); }
+	uint64_t Size() const { return fileSize; }
+	unsigned long long WindowsMapped() const { return windowsMapped; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Handle owns the open file; it is shared with the windows so their page cache can still be released after Close()
+	struct Handle
+	{
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+		~Handle()
+		{
+			if (mapping != nullptr) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		}
+#else
+		int fd = -1;
+		~Handle()
+		{
+			if (fd >= 0) close(fd);
+		}
+#endif
+	};
+
+	struct Window
+	{
+		std::shared_ptr<Handle> handle;
+		char* base = nullptr;
+		uint64_t offset = 0; // file offset of base
+		size_t length = 0;
+		~Window()
+		{
+			if (base == nullptr) return;
+#ifdef _WIN32
+			UnmapViewOfFile(base);
+#else
+			munmap(base, length);
+			posix_fadvise(handle->fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#endif
+		}
+	};
+
+	static uint64_t AllocationGranularity()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	// Map maps the window starting at the granule holding offset, large enough for length bytes and at most up to the end of the file
+	std::shared_ptr<Window> Map(uint64_t offset, size_t length)
+	{
+		std::shared_ptr<Window> w = std::make_shared<Window>();
+		w->handle = handle;
+		w->offset = offset - offset % granularity;
+		uint64_t end = w->offset + k_windowBytes;
+		if (end < offset + length) end = offset + length;
+		if (end > fileSize) end = fileSize;
+		w->length = static_cast<size_t>(end - w->offset);
+#ifdef _WIN32
+		void* p = MapViewOfFile(handle->mapping, FILE_MAP_READ, static_cast<DWORD>(w->offset >> 32), static_cast<DWORD>(w->offset & 0xFFFFFFFF), w->length);
+		if (p == nullptr) return nullptr;
+		w->base = static_cast<char*>(p);
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = p;
+		range.NumberOfBytes = w->length;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0); // start reading the whole window ahead of the caller
+#else
+		void* p = mmap(nullptr, w->length, PROT_READ, MAP_SHARED, handle->fd, static_cast<off_t>(w->offset));
+		if (p == MAP_FAILED) return nullptr;
+		w->base = static_cast<char*>(p);
+		madvise(p, w->length, MADV_SEQUENTIAL);
+#endif
+		windowsMapped++;
+		return w;
+	}
+
+	std::shared_ptr<Handle> handle;
+	std::shared_ptr<Window> window; // current window
+	uint64_t fileSize;
+	const uint64_t granularity;
+	unsigned long long windowsMapped;
+};
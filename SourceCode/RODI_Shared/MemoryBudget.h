@@ -0,0 +1,75 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// MemoryBudget accounts the frame buffers of all conversion pipelines of a process against one limit (maxRAM in metadata.txt). A pipeline
+// reserves the bytes of a buffer before it allocates it and returns them when the buffer is freed. Acquire waits until the bytes fit, or
+// until nothing else is reserved, so a single pipeline always makes progress even if one frame is larger than the budget. TryAcquire is
+// used to grow a pipeline beyond its first buffer: when it fails, the pipeline has to wait for its own buffers (backpressure).
+//========================================================================================================================================
+
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(uint64_t limitBytes = 0) : limit(limitBytes), used(0), peak(0), denied(0) {}
+
+	// SetLimit changes the budget, 0 = no limit
+	void SetLimit(uint64_t limitBytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		limit = limitBytes;
+		released.notify_all();
+	}
+
+	void Acquire(uint64_t bytes)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this, bytes] { return Fits(bytes) || used == 0; });
+		Reserve(bytes);
+	}
+
+	bool TryAcquire(uint64_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!Fits(bytes))
+		{
+			denied++;
+			return false;
+		}
+		Reserve(bytes);
+		return true;
+	}
+
+	void Release(uint64_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		used = bytes < used ? used - bytes : 0;
+		released.notify_all();
+	}
+
+	uint64_t Limit() const { std::lock_guard<std::mutex> lock(mutex); return limit; }
+	uint64_t Used() const { std::lock_guard<std::mutex> lock(mutex); return used; }
+	uint64_t Peak() const { std::lock_guard<std::mutex> lock(mutex); return peak; } // highest reservation so far
+	unsigned long long Denied() const { std::lock_guard<std::mutex> lock(mutex); return denied; } // TryAcquire calls refused by the limit
+
+private:
+	MemoryBudget(const MemoryBudget&) = delete;
+	MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+	bool Fits(uint64_t bytes) const { return limit == 0 || used + bytes <= limit; }
+	void Reserve(uint64_t bytes)
+	{
+		used += bytes;
+		if (used > peak) peak = used;
+	}
+
+	uint64_t limit;
+	uint64_t used;
+	uint64_t peak;
+	unsigned long long denied;
+	mutable std::mutex mutex;
+	std::condition_variable released;
+};
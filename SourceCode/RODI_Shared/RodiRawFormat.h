@@ -0,0 +1,465 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// RODI raw container format of the .tmp files written by RODI_REC and read by RODI_CONV and RODI_BoundB.
+//
+//	RodiFileHeader		k_rodiHeaderSize bytes: geometry, pixel format, exposure, gain, FPS, serial number, ...
+//	RodiFrameHeader		per frame: FrameID, camera timestamp, payload size
+//	payload				frame data (payloadSize bytes)
+//	...
+//	seek table			uint64_t file offset of every RodiFrameHeader
+//	RodiSeekFooter		number of frames and offset of the seek table, always the last bytes of the file
+//
+// With compression = RODI_COMPRESSION_BAYER the payloads are compressed losslessly with BayerCodec, except frames flagged k_rodiFrameRaw.
+// ReadFrame always returns the decoded frame. ViewFrame hands out frames without copying from a memory-mapped sliding window (MappedFile)
+// after Map(); compressed frames are decoded straight from the mapping. The header is padded to 4096 bytes so frame data written with
+// direct I/O stays aligned. RodiRawReader validates a file when it is opened: if the seek footer is missing (recording interrupted) the
+// frame headers are scanned instead and a truncated last frame is dropped. Files without a RodiFileHeader are legacy headerless .tmp
+// files: fixed-size frames of legacyWidth x legacyHeight BayerRG8.
+//========================================================================================================================================
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include "BayerCodec.h"
+#include "MappedFile.h"
+
+static const uint32_t k_rodiVersion = 1;
+static const uint32_t k_rodiHeaderSize = 4096;
+static const uint32_t k_rodiFrameMagic = 0x4D524652; // "RFRM"
+static const char k_rodiFileMagic[8] = { 'R', 'O', 'D', 'I', 'R', 'A', 'W', '1' };
+static const char k_rodiSeekMagic[8] = { 'R', 'O', 'D', 'I', 'S', 'E', 'E', 'K' };
+static const uint32_t k_rodiFrameIncomplete = 0x1; // RodiFrameHeader flag: the camera delivered an incomplete image
+static const uint32_t k_rodiFrameRaw = 0x2; // RodiFrameHeader flag: payload stored uncompressed in a compressed file
+static const uint32_t k_rodiFrameMotion = 0x4; // RodiFrameHeader flag: the motion trigger of RODI_REC detected activity in this frame
+static const uint32_t k_rodiFrameDiscarded = 0x8; // FrameIndexRecord flag only: frame discarded by the motion trigger, not in the .tmp file
+
+// payload compression stored in RodiFileHeader::compression
+enum RodiCompression
+{
+	RODI_COMPRESSION_NONE = 0,
+	RODI_COMPRESSION_BAYER = 1 // BayerCodec: per-CFA-plane prediction and adaptive Rice coding (8-bit formats only)
+};
+
+// pixel formats stored in RodiFileHeader::pixelFormat
+enum RodiPixelFormat
+{
+	RODI_PIXEL_UNKNOWN = 0,
+	RODI_PIXEL_MONO8 = 1,
+	RODI_PIXEL_BAYERRG8 = 2,
+	RODI_PIXEL_BAYERGR8 = 3,
+	RODI_PIXEL_BAYERGB8 = 4,
+	RODI_PIXEL_BAYERBG8 = 5
+};
+
+#pragma pack(push, 1)
+struct RodiFileHeader
+{
+	char magic[8]; // k_rodiFileMagic
+	uint32_t version; // k_rodiVersion
+	uint32_t headerSize; // offset of the first frame
+	uint32_t width; // pixels
+	uint32_t height; // pixels
+	uint32_t pixelFormat; // RodiPixelFormat
+	char pixelFormatName[32]; // camera pixel format name, e.g. "BayerRG8"
+	uint32_t bitsPerPixel;
+	uint32_t frameBytes; // size of an uncompressed frame
+	uint32_t compression; // RodiCompression of the payloads
+	double exposureTime; // microseconds
+	double gain; // dB
+	double fps; // acquisition frame rate in Hz
+	char serialNumber[32]; // camera serial number
+	uint32_t fileNumber; // file number within the recording
+	int64_t createdTime; // seconds since 1970-01-01 UTC
+};
+
+struct RodiFrameHeader
+{
+	uint32_t magic; // k_rodiFrameMagic
+	uint32_t payloadSize; // bytes of frame data following this header
+	uint64_t frameID; // camera FrameID
+	uint64_t timestamp; // camera timestamp in nanoseconds
+	uint32_t flags; // k_rodiFrame* flags
+	uint32_t reserved;
+};
+
+struct RodiSeekFooter
+{
+	char magic[8]; // k_rodiSeekMagic
+	uint64_t numFrames; // entries in the seek table
+	uint64_t tableOffset; // file offset of the seek table
+};
+#pragma pack(pop)
+
+// RodiFrameView is a frame handed out by RodiRawReader::ViewFrame
+struct RodiFrameView
+{
+	const char* data = nullptr; // frame data (decoded if the file is compressed)
+	size_t size = 0; // bytes at data
+	size_t index = 0; // frame number within the file
+	uint32_t width = 0; // pixels
+	uint32_t height = 0; // pixels
+	uint32_t pixelFormat = RODI_PIXEL_UNKNOWN; // RodiPixelFormat
+	RodiFrameHeader frameHeader = {}; // FrameID, timestamp and flags (0 for legacy files)
+	std::shared_ptr<const void> keepAlive; // keeps the mapped window holding data alive, empty if data is in the caller's buffer
+};
+
+inline RodiPixelFormat RodiPixelFormatFromName(const std::string& name)
+{
+	if (name == "Mono8") return RODI_PIXEL_MONO8;
+	if (name == "BayerRG8") return RODI_PIXEL_BAYERRG8;
+	if (name == "BayerGR8") return RODI_PIXEL_BAYERGR8;
+	if (name == "BayerGB8") return RODI_PIXEL_BAYERGB8;
+	if (name == "BayerBG8") return RODI_PIXEL_BAYERBG8;
+	return RODI_PIXEL_UNKNOWN;
+}
+
+// RodiBayerRedCell returns the position of red in the 2x2 cell of a Bayer format (0 top left, 1 top right, 2 bottom left, 3 bottom
+// right; blue is at 3 - red), or -1 if pixelFormat is not a Bayer format
+inline int RodiBayerRedCell(uint32_t pixelFormat)
+{
+	switch (pixelFormat)
+	{
+	case RODI_PIXEL_BAYERRG8: return 0;
+	case RODI_PIXEL_BAYERGR8: return 1;
+	case RODI_PIXEL_BAYERGB8: return 2;
+	case RODI_PIXEL_BAYERBG8: return 3;
+	default: return -1;
+	}
+}
+
+inline int RodiSeek(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+	return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+inline uint64_t RodiFileSize(FILE* file)
+{
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	return static_cast<uint64_t>(_ftelli64(file));
+#else
+	fseeko(file, 0, SEEK_END);
+	return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+// RodiFileFinalized tells whether RODI_REC has finished the .tmp file at path: its last bytes are a seek footer matching the file size
+inline bool RodiFileFinalized(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr) return false;
+	const uint64_t fileSize = RodiFileSize(file);
+	RodiSeekFooter footer;
+	bool finalized = fileSize >= k_rodiHeaderSize + sizeof(footer) && RodiSeek(file, fileSize - sizeof(footer)) == 0
+		&& fread(&footer, sizeof(footer), 1, file) == 1 && memcmp(footer.magic, k_rodiSeekMagic, 8) == 0
+		&& footer.tableOffset + footer.numFrames * sizeof(uint64_t) + sizeof(footer) == fileSize;
+	fclose(file);
+	return finalized;
+}
+
+class RodiRawReader
+{
+public:
+	RodiRawReader() : file(nullptr), fileSize(0), legacy(false), recovered(false), truncatedBytes(0), decodedFrames(0), decodedBytes(0), decodeNs(0)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+	~RodiRawReader() { Close(); }
+
+	/*
+	Open reads and validates a .tmp file. legacyWidth and legacyHeight are only used for headerless files. Returns false if the file
+	cannot be opened or holds no complete frame.
+	*/
+	bool Open(const std::string& path, int legacyWidth, int legacyHeight)
+	{
+		Close();
+		file = fopen(path.c_str(), "rb");
+		if (file == nullptr) return false;
+		filePath = path;
+		fileSize = RodiFileSize(file);
+		RodiSeek(file, 0);
+		if (fileSize >= sizeof(header) && fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, k_rodiFileMagic, 8) == 0)
+		{
+			if (!ReadSeekTable()) ScanFrames();
+		}
+		else
+		{
+			OpenLegacy(legacyWidth, legacyHeight);
+		}
+		return !offsets.empty();
+	}
+
+	void Close()
+	{
+		if (file != nullptr) fclose(file);
+		file = nullptr;
+		mapped.Close();
+		offsets.clear();
+		legacy = false;
+		recovered = false;
+		truncatedBytes = 0;
+		decodedFrames = 0;
+		decodedBytes = 0;
+		decodeNs = 0;
+	}
+
+	/*
+	ReadFrame reads frame i into payload, decompressed if needed. frameHeader receives FrameID and timestamp (both 0 for legacy files).
+	Returns false for a frame whose header is damaged: an uncompressed payload must be one frame (frameBytes) and within the file.
+	*/
+	bool ReadFrame(size_t i, std::vector<char>& payload, RodiFrameHeader* frameHeader = nullptr)
+	{
+		if (file == nullptr || i >= offsets.size()) return false;
+		RodiFrameHeader fh;
+		memset(&fh, 0, sizeof(fh));
+		if (RodiSeek(file, offsets[i]) != 0) return false;
+		if (legacy)
+		{
+			fh.payloadSize = header.frameBytes;
+		}
+		else if (fread(&fh, sizeof(fh), 1, file) != 1 || fh.magic != k_rodiFrameMagic)
+		{
+			return false;
+		}
+		const bool packedFrame = header.compression == RODI_COMPRESSION_BAYER && (fh.flags & k_rodiFrameRaw) == 0;
+		if (!PayloadFits(fh, offsets[i] + (legacy ? 0 : sizeof(fh)), packedFrame)) return false;
+		if (packedFrame)
+		{
+			packed.resize(fh.payloadSize);
+			if (fh.payloadSize > 0 && fread(packed.data(), fh.payloadSize, 1, file) != 1) return false;
+			if (!Decode(packed.data(), packed.size(), payload)) return false;
+		}
+		else
+		{
+			payload.resize(fh.payloadSize);
+			if (fh.payloadSize > 0 && fread(payload.data(), fh.payloadSize, 1, file) != 1) return false;
+		}
+		if (frameHeader != nullptr) *frameHeader = fh;
+		return true;
+	}
+
+	/*
+	Map memory-maps the opened file for ViewFrame. Returns false if the file cannot be mapped; ViewFrame then falls back to ReadFrame.
+	*/
+	bool Map()
+	{
+		return file != nullptr && mapped.Open(filePath);
+	}
+
+	/*
+	ViewFrame returns frame i without copying it: view.data points into the mapped file and view.keepAlive keeps that part of the
+	mapping alive. Compressed frames are decoded into decodeBuffer, as are all frames if the file is not mapped.
+	*/
+	bool ViewFrame(size_t i, RodiFrameView& view, std::vector<char>& decodeBuffer)
+	{
+		if (file == nullptr || i >= offsets.size()) return false;
+		view.keepAlive.reset();
+		view.index = i;
+		view.width = header.width;
+		view.height = header.height;
+		view.pixelFormat = header.pixelFormat;
+		if (!mapped.IsOpen())
+		{
+			if (!ReadFrame(i, decodeBuffer, &view.frameHeader)) return false;
+			view.data = decodeBuffer.data();
+			view.size = decodeBuffer.size();
+			return true;
+		}
+		RodiFrameHeader& fh = view.frameHeader;
+		memset(&fh, 0, sizeof(fh));
+		uint64_t payloadOffset = offsets[i];
+		if (legacy)
+		{
+			fh.payloadSize = header.frameBytes;
+		}
+		else
+		{
+			const char* p = mapped.View(offsets[i], sizeof(fh));
+			if (p == nullptr) return false;
+			memcpy(&fh, p, sizeof(fh));
+			if (fh.magic != k_rodiFrameMagic) return false;
+			payloadOffset += sizeof(fh);
+		}
+		const bool packedFrame = header.compression == RODI_COMPRESSION_BAYER && (fh.flags & k_rodiFrameRaw) == 0;
+		if (!PayloadFits(fh, payloadOffset, packedFrame)) return false;
+		if (packedFrame)
+		{
+			const char* p = mapped.View(payloadOffset, fh.payloadSize);
+			if (p == nullptr || !Decode(reinterpret_cast<const uint8_t*>(p), fh.payloadSize, decodeBuffer)) return false;
+			view.data = decodeBuffer.data();
+			view.size = decodeBuffer.size();
+			return true;
+		}
+		view.data = mapped.View(payloadOffset, fh.payloadSize, &view.keepAlive);
+		view.size = fh.payloadSize;
+		return view.data != nullptr;
+	}
+
+	/*
+	FindFrame returns the first frame whose FrameID (byTimestamp = false) or camera timestamp is at least key, or NumFrames() if there is
+	none. It bisects the seek table and reads O(log n) frame headers, relying on FrameIDs and timestamps increasing within a file. Legacy
+	files have neither and return NumFrames().
+	*/
+	size_t FindFrame(uint64_t key, bool byTimestamp)
+	{
+		if (legacy) return offsets.size();
+		size_t lo = 0;
+		size_t hi = offsets.size();
+		while (lo < hi)
+		{
+			const size_t mid = lo + (hi - lo) / 2;
+			RodiFrameHeader fh;
+			if (file == nullptr || RodiSeek(file, offsets[mid]) != 0 || fread(&fh, sizeof(fh), 1, file) != 1 || fh.magic != k_rodiFrameMagic) return offsets.size();
+			if ((byTimestamp ? fh.timestamp : fh.frameID) < key) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+
+	// FrameAtOffset returns the frame stored at file offset (a FrameIndexRecord::byteOffset), or NumFrames() if no frame starts there
+	size_t FrameAtOffset(uint64_t offset) const
+	{
+		const std::vector<uint64_t>::const_iterator it = std::lower_bound(offsets.begin(), offsets.end(), offset);
+		return it != offsets.end() && *it == offset ? static_cast<size_t>(it - offsets.begin()) : offsets.size();
+	}
+
+	const RodiFileHeader& Header() const { return header; }
+	uint32_t Width() const { return header.width; }
+	uint32_t Height() const { return header.height; }
+	uint32_t FrameBytes() const { return header.frameBytes; }
+	std::string PixelFormatName() const { return std::string(header.pixelFormatName); }
+	size_t NumFrames() const { return offsets.size(); }
+	uint64_t FrameOffset(size_t i) const { return offsets[i]; }
+	uint64_t FileSize() const { return fileSize; }
+	bool IsLegacy() const { return legacy; }
+	bool Recovered() const { return recovered; } // seek table was rebuilt by scanning the frame headers
+	uint64_t TruncatedBytes() const { return truncatedBytes; } // trailing bytes that do not form a complete frame
+	bool Compressed() const { return header.compression != RODI_COMPRESSION_NONE; }
+	bool Mapped() const { return mapped.IsOpen(); }
+	unsigned long long WindowsMapped() const { return mapped.WindowsMapped(); } // sliding windows mapped by ViewFrame so far
+	// DecodeStats returns the compression ratio and the decoding time per frame of the compressed frames read so far
+	std::string DecodeStats() const
+	{
+		std::stringstream ss;
+		ss << decodedFrames << " compressed frames decoded";
+		if (decodedFrames > 0)
+		{
+			ss << ", compression ratio " << static_cast<double>(decodedFrames) * header.frameBytes / decodedBytes << ", "
+				<< decodeNs / 1e6 / decodedFrames << " ms per frame";
+		}
+		return ss.str();
+	}
+
+	// Describe returns a one-line summary of the file for console output.
+	std::string Describe() const
+	{
+		std::stringstream ss;
+		ss << (legacy ? "legacy headerless file, " : "RODI raw v") ;
+		if (!legacy) ss << header.version << " (" << header.serialNumber << "), ";
+		ss << header.width << "x" << header.height << " " << header.pixelFormatName << ", " << offsets.size() << " frames";
+		if (header.compression == RODI_COMPRESSION_BAYER) ss << " (lossless compressed)";
+		if (!legacy) ss << " @ " << header.fps << " fps, exposure " << header.exposureTime << " us, gain " << header.gain << " dB";
+		if (recovered) ss << ", seek table missing (rebuilt by scanning)";
+		if (truncatedBytes > 0) ss << ", " << truncatedBytes << " bytes of a truncated frame ignored";
+		return ss.str();
+	}
+
+private:
+	RodiRawReader(const RodiRawReader&) = delete;
+	RodiRawReader& operator=(const RodiRawReader&) = delete;
+
+	void OpenLegacy(int legacyWidth, int legacyHeight)
+	{
+		legacy = true;
+		memset(&header, 0, sizeof(header));
+		header.width = legacyWidth;
+		header.height = legacyHeight;
+		header.pixelFormat = RODI_PIXEL_BAYERRG8;
+		strncpy(header.pixelFormatName, "BayerRG8", sizeof(header.pixelFormatName) - 1);
+		header.bitsPerPixel = 8;
+		header.frameBytes = static_cast<uint32_t>(legacyWidth) * static_cast<uint32_t>(legacyHeight);
+		if (header.frameBytes == 0) return;
+		const uint64_t numFrames = fileSize / header.frameBytes;
+		truncatedBytes = fileSize - numFrames * header.frameBytes;
+		for (uint64_t i = 0; i < numFrames; i++)
+		{
+			offsets.push_back(i * header.frameBytes);
+		}
+	}
+
+	// PayloadFits tells whether the payload of frame header fh at payloadOffset lies within the file and, unless packed, is exactly one frame
+	bool PayloadFits(const RodiFrameHeader& fh, uint64_t payloadOffset, bool packedFrame) const
+	{
+		return payloadOffset <= fileSize && fh.payloadSize <= fileSize - payloadOffset && (packedFrame || fh.payloadSize == header.frameBytes);
+	}
+
+	// Decode decompresses a BayerCodec payload into frame and keeps the decoding statistics
+	bool Decode(const uint8_t* src, size_t srcSize, std::vector<char>& frame)
+	{
+		frame.resize(header.frameBytes);
+		const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		if (!BayerCodec::Decode(src, srcSize, header.width, header.height, reinterpret_cast<uint8_t*>(frame.data()))) return false;
+		decodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+		decodedFrames++;
+		decodedBytes += srcSize;
+		return true;
+	}
+
+	bool ReadSeekTable()
+	{
+		RodiSeekFooter footer;
+		if (fileSize < header.headerSize + sizeof(footer)) return false;
+		if (RodiSeek(file, fileSize - sizeof(footer)) != 0 || fread(&footer, sizeof(footer), 1, file) != 1) return false;
+		if (memcmp(footer.magic, k_rodiSeekMagic, 8) != 0) return false;
+		if (footer.tableOffset + footer.numFrames * sizeof(uint64_t) + sizeof(footer) != fileSize) return false;
+		offsets.resize(static_cast<size_t>(footer.numFrames));
+		if (RodiSeek(file, footer.tableOffset) != 0) return false;
+		if (!offsets.empty() && fread(offsets.data(), sizeof(uint64_t), offsets.size(), file) != offsets.size())
+		{
+			offsets.clear();
+			return false;
+		}
+		return true;
+	}
+
+	void ScanFrames()
+	{
+		recovered = true;
+		offsets.clear();
+		uint64_t offset = header.headerSize;
+		RodiFrameHeader fh;
+		while (offset + sizeof(fh) <= fileSize)
+		{
+			if (RodiSeek(file, offset) != 0 || fread(&fh, sizeof(fh), 1, file) != 1 || fh.magic != k_rodiFrameMagic) break;
+			if (offset + sizeof(fh) + fh.payloadSize > fileSize) break; // truncated last frame
+			offsets.push_back(offset);
+			offset += sizeof(fh) + fh.payloadSize;
+		}
+		truncatedBytes = fileSize - offset;
+	}
+
+	FILE* file;
+	std::string filePath;
+	MappedFile mapped; // memory mapping used by ViewFrame
+	uint64_t fileSize;
+	RodiFileHeader header;
+	std::vector<uint64_t> offsets; // seek table
+	bool legacy;
+	bool recovered;
+	uint64_t truncatedBytes;
+	std::vector<uint8_t> packed; // compressed payload of the last frame read
+	unsigned long long decodedFrames;
+	unsigned long long decodedBytes; // compressed bytes of the decoded frames
+	long long decodeNs;
+};
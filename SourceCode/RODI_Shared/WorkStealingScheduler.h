@@ -0,0 +1,137 @@
+#pragma once
+//========================================================================================================================================
+// RODI - Riverine Organism Drift Imager (shared)
+// WorkStealingScheduler runs a batch of independent jobs (the files of RODI_CONV) on a fixed number of worker threads. Every worker owns a
+// queue of jobs. The jobs are dealt out largest first, so all queues start with a similar total cost. A worker takes the next job from
+// the front of its own queue. When its queue is empty, it steals from the back of the queue with the most remaining cost, so long and
+// short files balance out without a central queue. The work function must not throw; a failed job is reported by the caller.
+//========================================================================================================================================
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+class WorkStealingScheduler
+{
+public:
+	explicit WorkStealingScheduler(size_t numWorkers) : queues(numWorkers < 1 ? 1 : numWorkers), jobsRun(queues.size(), 0), jobsStolen(queues.size(), 0) {}
+
+	// Add registers job (an index chosen by the caller) with its estimated cost, before Run()
+	void Add(size_t job, uint64_t cost) { pending.push_back(Job{ job, cost }); }
+
+	/*
+	Run deals the jobs out and calls work(worker, job) on the worker threads until every job is done. With one worker the jobs run on the
+	calling thread in the order they were added.
+	*/
+	void Run(const std::function<void(size_t, size_t)>& work)
+	{
+		if (queues.size() > 1)
+		{
+			std::stable_sort(pending.begin(), pending.end(), [](const Job& a, const Job& b) { return a.cost > b.cost; });
+		}
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			Queue& queue = queues[i % queues.size()];
+			queue.jobs.push_back(pending[i]);
+			queue.cost += pending[i].cost;
+		}
+		pending.clear();
+		if (queues.size() == 1)
+		{
+			WorkerLoop(0, work);
+			return;
+		}
+		std::vector<std::thread> workers;
+		for (size_t w = 0; w < queues.size(); w++)
+		{
+			workers.push_back(std::thread(&WorkStealingScheduler::WorkerLoop, this, w, std::cref(work)));
+		}
+		for (size_t w = 0; w < workers.size(); w++)
+		{
+			workers[w].join();
+		}
+	}
+
+	size_t Workers() const { return queues.size(); }
+	unsigned long long JobsRun(size_t worker) const { return jobsRun[worker]; }
+	unsigned long long JobsStolen(size_t worker) const { return jobsStolen[worker]; }
+
+private:
+	struct Job
+	{
+		size_t id;
+		uint64_t cost;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		uint64_t cost = 0; // remaining cost of the jobs in the queue
+	};
+
+	WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+	WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+	void WorkerLoop(size_t worker, const std::function<void(size_t, size_t)>& work)
+	{
+		Job job;
+		while (Next(worker, job))
+		{
+			work(worker, job.id);
+			jobsRun[worker]++;
+		}
+	}
+
+	bool Next(size_t worker, Job& job)
+	{
+		{
+			Queue& own = queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs.empty())
+			{
+				job = own.jobs.front();
+				own.jobs.pop_front();
+				own.cost -= job.cost;
+				return true;
+			}
+		}
+		// steal from the queue with the most remaining cost; the queues only shrink, so a failed pass means all work is handed out
+		while (true)
+		{
+			size_t victim = queues.size();
+			uint64_t victimCost = 0;
+			bool anyJobs = false;
+			for (size_t q = 0; q < queues.size(); q++)
+			{
+				std::lock_guard<std::mutex> lock(queues[q].mutex);
+				if (queues[q].jobs.empty()) continue;
+				anyJobs = true;
+				if (victim == queues.size() || queues[q].cost > victimCost)
+				{
+					victim = q;
+					victimCost = queues[q].cost;
+				}
+			}
+			if (!anyJobs) return false;
+			Queue& other = queues[victim];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if (other.jobs.empty()) continue; // emptied in the meantime, look again
+			job = other.jobs.back();
+			other.jobs.pop_back();
+			other.cost -= job.cost;
+			jobsStolen[worker]++;
+			return true;
+		}
+	}
+
+	std::vector<Job> pending;
+	std::vector<Queue> queues;
+	std::vector<unsigned long long> jobsRun; // each entry is only written by its own worker
+	std::vector<unsigned long long> jobsStolen;
+};